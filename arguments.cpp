@@ -0,0 +1,288 @@
+#include "arguments.h"
+
+#include <set>
+
+/******************************************************************************/
+
+namespace
+{
+  struct Option
+  {
+    std::string shortName;     // e.g. "-o", may be empty
+    std::string longName;      // e.g. "--output", may be empty
+    bool argument = false;     // takes a value
+    bool hasDefault = false;
+    std::string defaultValue;
+    bool repeatable = false;   // given as "[-o FILE]..." in a usage pattern
+    bool selectsPattern = false; // required element of a usage pattern
+
+    const std::string& key() const { return longName.empty() ? shortName : longName; }
+  };
+
+  // Splits text at the given separators, dropping empty parts
+  std::vector<std::string> split(const std::string& text, const char* separators)
+  {
+    std::vector<std::string> parts;
+
+    for (std::size_t start = 0, end; start < text.size(); start = end + 1)
+    {
+      end = text.find_first_of(separators, start);
+      if (end == std::string::npos)
+        end = text.size();
+      if (end > start)
+        parts.push_back(text.substr(start, end - start));
+    }
+
+    return parts;
+  }
+
+  // Lines of the section starting with the given header up to the next empty line
+  std::vector<std::string> section(const std::string& usage, const std::string& header)
+  {
+    std::vector<std::string> lines;
+    std::size_t start = usage.find(header);
+    if (start == std::string::npos)
+      return lines;
+
+    // Skip the rest of the header line (usually empty)
+    start = usage.find('\n', start);
+
+    while (start != std::string::npos && start + 1 < usage.size())
+    {
+      std::size_t end = usage.find('\n', start + 1);
+      std::string line = usage.substr(start + 1, end == std::string::npos ? std::string::npos : end - start - 1);
+
+      if (line.find_first_not_of(' ') == std::string::npos)
+        break;
+
+      lines.push_back(line);
+      start = end;
+    }
+
+    return lines;
+  }
+
+  // Options with their defaults from the "Options:" section
+  std::vector<Option> parseOptions(const std::vector<std::string>& lines)
+  {
+    std::vector<Option> options;
+    std::string description;
+
+    auto takeDefault = [&]
+    {
+      std::size_t start = description.find("[default: ");
+      if (options.empty() || start == std::string::npos)
+        return;
+
+      start += 10;
+      options.back().hasDefault = true;
+      options.back().defaultValue = description.substr(start, description.find(']', start) - start);
+    };
+
+    for (const auto& line : lines)
+    {
+      std::size_t start = line.find_first_not_of(' ');
+
+      // Continuation of the previous description
+      if (line[start] != '-')
+      {
+        description += ' ' + line.substr(start);
+        continue;
+      }
+
+      takeDefault();
+
+      // The names end where the description starts (after at least two spaces)
+      std::size_t end = line.find("  ", start);
+      std::string names = line.substr(start, end == std::string::npos ? std::string::npos : end - start);
+      description = end == std::string::npos ? std::string() : line.substr(end);
+
+      Option option;
+      for (const auto& token : split(names, " ,="))
+      {
+        if (token.compare(0, 2, "--") == 0)
+          option.longName = token;
+        else if (token[0] == '-')
+          option.shortName = token;
+        else
+          option.argument = true;
+      }
+
+      options.push_back(option);
+    }
+
+    takeDefault();
+    return options;
+  }
+
+  Option* findOption(std::vector<Option>& options, const std::string& name)
+  {
+    for (auto& option : options)
+      if (option.shortName == name || option.longName == name)
+        return &option;
+
+    return nullptr;
+  }
+
+  // Marks the options that may be repeated or select a usage pattern, and
+  // returns the name of the repeated positional argument of the first pattern
+  // (empty if it does not have exactly one)
+  std::string parsePatterns(const std::vector<std::string>& lines, std::vector<Option>& options)
+  {
+    std::string positional;
+    std::size_t positionals = 0;
+
+    for (std::size_t l = 0; l < lines.size(); ++l)
+    {
+      const std::string& line = lines[l];
+
+      // Options within each open bracket
+      std::vector<std::vector<Option*>> brackets;
+
+      for (std::size_t i = 0; i < line.size();)
+      {
+        char c = line[i];
+
+        if (c == ' ')
+          ++i;
+        else if (c == '[' || c == '(')
+        {
+          brackets.emplace_back();
+          ++i;
+        }
+        else if (c == ']' || c == ')')
+        {
+          bool repeated = line.compare(i + 1, 3, "...") == 0;
+          if (repeated && !brackets.empty())
+            for (auto option : brackets.back())
+              option->repeatable = true;
+
+          if (!brackets.empty())
+            brackets.pop_back();
+          i += repeated ? 4 : 1;
+        }
+        else
+        {
+          std::size_t end = line.find_first_of(" []()", i);
+          std::string token = line.substr(i, end == std::string::npos ? std::string::npos : end - i);
+          i += token.size();
+
+          bool repeated = token.size() > 3 && token.compare(token.size() - 3, 3, "...") == 0;
+          if (repeated)
+            token.resize(token.size() - 3);
+
+          Option* option = token != "--" && token[0] == '-' ? findOption(options, token) : nullptr;
+
+          if (option && brackets.empty())
+            option->selectsPattern = true;
+          for (auto& bracket : brackets)
+            if (option)
+              bracket.push_back(option);
+
+          if (l == 0 && token[0] == '<')
+          {
+            positional = repeated ? token : std::string();
+            ++positionals;
+          }
+        }
+      }
+    }
+
+    return positionals == 1 ? positional : std::string();
+  }
+}
+
+/******************************************************************************/
+
+bool parseSimpleArguments(const std::string& usage,
+                          const std::vector<std::string>& arguments,
+                          std::map<std::string, docopt::value>& args)
+{
+  std::vector<Option> options = parseOptions(section(usage, "Options:"));
+  std::string positional = parsePatterns(section(usage, "Usage:"), options);
+
+  if (positional.empty())
+    return false;
+
+  // Defaults
+  std::map<std::string, docopt::value> result;
+  for (const auto& option : options)
+  {
+    if (!option.argument)
+      result[option.key()] = docopt::value(false);
+    else if (option.repeatable)
+      result[option.key()] = docopt::value(split(option.defaultValue, " "));
+    else if (option.hasDefault)
+      result[option.key()] = docopt::value(option.defaultValue);
+    else
+      result[option.key()] = docopt::value();
+  }
+
+  std::vector<std::string> files;
+  std::set<std::string> given;
+  bool separator = false;
+
+  for (std::size_t i = 0; i < arguments.size(); ++i)
+  {
+    const std::string& argument = arguments[i];
+
+    if (separator || argument.size() < 2 || argument[0] != '-')
+    {
+      files.push_back(argument);
+      continue;
+    }
+
+    if (argument == "--")
+    {
+      separator = true;
+      continue;
+    }
+
+    // "--name=value" is fine, anything else unusual is left to docopt
+    std::size_t equals = argument.compare(0, 2, "--") == 0 ? argument.find('=') : std::string::npos;
+    Option* option = findOption(options, argument.substr(0, equals));
+
+    if (!option || option->selectsPattern || option->key() == "--help" || option->key() == "--version" ||
+        (given.count(option->key()) && !option->repeatable) ||
+        (equals != std::string::npos && !option->argument))
+      return false;
+
+    docopt::value& value = result[option->key()];
+
+    if (!option->argument)
+      value = docopt::value(true);
+    else
+    {
+      std::string text;
+      if (equals != std::string::npos)
+        text = argument.substr(equals + 1);
+      else if (i + 1 < arguments.size())
+        text = arguments[++i];
+      else
+        return false;
+
+      if (!option->repeatable)
+        value = docopt::value(text);
+      else
+      {
+        // Given values replace the default
+        std::vector<std::string> values;
+        if (given.count(option->key()))
+          values = value.asStringList();
+        values.push_back(text);
+        value = docopt::value(values);
+      }
+    }
+
+    given.insert(option->key());
+  }
+
+  if (files.empty())
+    return false;
+
+  result[positional] = docopt::value(files);
+  result["--"] = docopt::value(separator);
+
+  args = std::move(result);
+  return true;
+}
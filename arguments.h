@@ -0,0 +1,23 @@
+#ifndef ARGUMENTS_H
+#define ARGUMENTS_H
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "docopt.h"
+
+/******************************************************************************/
+
+// Parses simple command lines without docopt, whose regular expressions take
+// most of the startup time of short runs. The options, their defaults and
+// which of them may be repeated are read from the usage text, so the result
+// equals docopt's. Simple means that every option is given on its own
+// ("-q -y", not "-qy") under its full name, at most once unless it may be
+// repeated, followed by the files of the first usage pattern. Returns false
+// for everything else (including --help and --version), leaving it to docopt.
+bool parseSimpleArguments(const std::string& usage,
+                          const std::vector<std::string>& arguments,
+                          std::map<std::string, docopt::value>& args);
+
+#endif // ARGUMENTS_H
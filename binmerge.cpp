@@ -4,122 +4,196 @@
 #include <vector>
 #include <array>
 #include <algorithm>
+#include <cctype>
+#include <climits>
+#include <cstdlib>
+#include <chrono>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
 
 #include "docopt.h"
 
+#include "arguments.h"
+#include "binmerge.h"
+#include "cluster.h"
+#include "combine.h"
+#include "consistency.h"
+#include "copy.h"
+#include "digest.h"
+#include "estimate.h"
+#include "extract.h"
+#include "index.h"
+#include "inputs.h"
+#include "kernels.h"
+#include "output.h"
+#include "repair.h"
+#include "trim.h"
+#include "ts.h"
+#include "tsstats.h"
+#include "update.h"
+#include "verify.h"
+#include "workqueue.h"
+
 /******************************************************************************/
 
-struct MatchResult
+namespace
 {
-  // Results of the pattern search
-  bool patternFound = false;
-  std::size_t matchPosition = 0; // position of the first byte of the match
-  std::size_t patternSize = 0;
-
-  // Results of the byte-wise comparison of the overlapping area
-  std::size_t bytesDiffering = 0;
-
-  // Some useful methods
-  std::size_t overlapCount() const
+  // Slides a buffer of two blocks over the file from pos on and calls
+  // find(start, stop, position) for every block. Matches have to start in
+  // the first block and may reach reach bytes far. Matches starting length
+  // bytes or more behind pos are not searched for.
+  template <typename Find>
+  MatchResult scanFile(std::istream& file, std::streampos pos, std::size_t reach, std::uint64_t length, Find find)
   {
-    return matchPosition + patternSize;
-  }
+    constexpr std::size_t blockSize = 64 << 10;
 
-  double quota() const
-  {
-    if (!patternFound || overlapCount() == 0)
-      return 0.0;
-    else
-      return static_cast<double>(overlapCount()-bytesDiffering) / overlapCount();
-  }
-};
+    // Allocate "rolling" buffer (uninitialized, small files only touch its start)
+    std::unique_ptr<unsigned char[]> buffer(new unsigned char[2 * blockSize]);
 
-MatchResult searchInFile(std::istream& file, std::vector<unsigned char>& pattern, std::streampos pos = 0)
-{
-  constexpr std::size_t blockSize = 4096;
+    // Read first block
+    file.clear();
+    file.seekg(pos);
+    file.read(reinterpret_cast<char*>(&buffer[0]), blockSize);
+    std::size_t bytesReadPreviously = file.gcount();
 
-  // Allocate "rolling" buffer
-  std::array<unsigned char, 2 * blockSize> buffer;
+    // Sanity check (less bytes than requested despite no eof)
+    if (bytesReadPreviously < blockSize && !file.eof())
+      throw std::system_error();
 
-  // Read first block
-  file.clear();
-  file.seekg(pos);
-  file.read(reinterpret_cast<char*>(&buffer[0]), blockSize);
-  std::size_t bytesReadPreviously = file.gcount();
+    std::size_t realBufferSize = bytesReadPreviously;
+    std::size_t position = pos;
 
-  // Sanity check (less bytes than requested despite no eof)
-  if (bytesReadPreviously < blockSize && !file.eof())
-    throw std::system_error();
+    // First position at which a match may not start
+    std::uint64_t end = length > UINT64_MAX - position ? UINT64_MAX : position + length;
 
-  std::size_t realBufferSize = bytesReadPreviously;
-  std::size_t position = pos;
+    while (file || realBufferSize >= reach)
+    {
+      // Pre-read next block and append to current block
+      file.read(reinterpret_cast<char*>(&buffer[bytesReadPreviously]), blockSize);
+      std::size_t bytesRead = file.gcount();
+
+      // Sanity check (less bytes than requested despite no eof)
+      if (bytesRead < blockSize && !file.eof())
+        throw std::system_error();
+
+      // Calculate the buffer's current fill level
+      realBufferSize = bytesReadPreviously + bytesRead;
+
+      // Define range of the buffer that will be searched
+      // The first byte of the searched pattern has to lie in the first half
+      const unsigned char* start = &buffer[0];
+      const unsigned char* stop  = &buffer[std::min(bytesReadPreviously + reach - 1, realBufferSize)];
+      if (end - position < bytesReadPreviously)
+        stop = std::min(stop, start + (end - position) + reach - 1);
+
+      // Perform search within specified range
+      MatchResult result = find(start, stop, position);
+      if (result.patternFound)
+        return result;
+
+      // Shift pre-read block to the beginning of the buffer
+      std::copy(&buffer[bytesReadPreviously], &buffer[realBufferSize], &buffer[0]);
+      position += bytesReadPreviously;
+
+      if (position >= end)
+        break;
 
-  while (file || realBufferSize >= pattern.size())
-  {
-    // Pre-read next block and append to current block
-    file.read(reinterpret_cast<char*>(&buffer[bytesReadPreviously]), blockSize);
-    std::size_t bytesRead = file.gcount();
+      bytesReadPreviously = bytesRead;
+    }
 
-    // Sanity check (less bytes than requested despite no eof)
-    if (bytesRead < blockSize && !file.eof())
-      throw std::system_error();
+    return MatchResult{};
+  }
+}
 
-    // Calculate the buffer's current fill level
-    realBufferSize = bytesReadPreviously + bytesRead;
+MatchResult searchInFile(std::istream& file, std::vector<unsigned char>& pattern, std::streampos pos,
+                         std::size_t stride, std::size_t phase, std::uint64_t length)
+{
+  // Chosen once, the loop in scanFile() only calls it
+  SearchKernel search = selectSearchKernel(pattern.size(), stride);
 
-    // Define range of the buffer that will be searched
-    // The first byte of the searched pattern has to lie in the first half
-    auto start = &buffer[0];
-    auto stop  = &buffer[std::min(bytesReadPreviously + pattern.size() - 1, realBufferSize)];
+  return scanFile(file, pos, pattern.size(), length,
+                  [&](const unsigned char* start, const unsigned char* stop, std::size_t position)
+  {
+    // First candidate within the buffer
+    std::size_t first = (phase + stride - position % stride) % stride;
 
-    // Perform search within specified range
-    auto result = std::search(start, stop, pattern.begin(), pattern.end());
-    if (result != stop)
+    auto result = search(start, stop, pattern.data(), pattern.size(), first);
+    if (result)
       return MatchResult{true, position + std::distance(start, result), pattern.size()};
 
-    // Shift pre-read block to the beginning of the buffer
-    std::copy(&buffer[bytesReadPreviously], &buffer[buffer.size()], &buffer[0]);
-    position += bytesReadPreviously;
+    return MatchResult{};
+  });
+}
 
-    bytesReadPreviously = bytesRead;
-  }
+MatchResult searchBitsInFile(std::istream& file, const std::vector<unsigned char>& pattern,
+                             std::uint64_t bitPosition)
+{
+  BitPattern bitPattern(pattern);
+  std::uint64_t pos = bitPosition / 8;
+
+  // Shifted patterns reach into one more byte
+  return scanFile(file, pos, pattern.size() + 1, UINT64_MAX,
+                  [&](const unsigned char* start, const unsigned char* stop, std::size_t position)
+  {
+    unsigned firstShift = position == pos ? bitPosition % 8 : 0, shift;
+
+    auto result = searchBits(start, stop, bitPattern, firstShift, shift);
+    if (result)
+      return MatchResult{true, position + std::distance(start, result), pattern.size(), shift};
 
-  return MatchResult{};
+    return MatchResult{};
+  });
 }
 
 /******************************************************************************/
 
-std::size_t compareFiles(std::istream& file1, std::istream& file2)
+std::size_t compareFiles(std::istream& file1, std::istream& file2, unsigned shift)
 {
-  constexpr std::size_t blockSize = 4096;
+  constexpr std::size_t blockSize = 64 << 10;
 
-  // Allocate buffers
-  std::array<unsigned char, blockSize> buffer1, buffer2;
+  // Allocate buffers (the second one keeps a byte for shifting)
+  std::unique_ptr<unsigned char[]> buffer1(new unsigned char[blockSize]), buffer2(new unsigned char[blockSize + 1]);
+  std::unique_ptr<unsigned char[]> shifted(shift > 0 ? new unsigned char[blockSize] : nullptr);
 
-  std::size_t bytesTotal = 0, bytesDifferent = 0;
+  std::size_t bytesTotal = 0, bytesDifferent = 0, carried = 0;
 
   do
   {
     // Read next blocks
+    std::size_t bytesRequested2 = shift > 0 ? blockSize + 1 - carried : blockSize;
     file1.read(reinterpret_cast<char*>(&buffer1[0]), blockSize);
-    file2.read(reinterpret_cast<char*>(&buffer2[0]), blockSize);
+    file2.read(reinterpret_cast<char*>(&buffer2[carried]), bytesRequested2);
 
     std::size_t bytesRead1 = file1.gcount();
     std::size_t bytesRead2 = file2.gcount();
 
     // Sanity check (less bytes than requested despite no eof)
     if ((bytesRead1 < blockSize && !file1.eof()) ||
-        (bytesRead2 < blockSize && !file2.eof()))
+        (bytesRead2 < bytesRequested2 && !file2.eof()))
       throw std::system_error();
 
+    const unsigned char* data2 = &buffer2[0];
+    std::size_t available2 = bytesRead2;
+
+    // Shifted bytes are made of two bytes each, the last one waits for the next block
+    if (shift > 0)
+    {
+      available2 = carried + bytesRead2 > 0 ? carried + bytesRead2 - 1 : 0;
+      for (std::size_t k = 0; k < available2; ++k)
+        shifted[k] = static_cast<unsigned char>(buffer2[k] << shift | buffer2[k+1] >> (8 - shift));
+
+      data2 = &shifted[0];
+      carried = carried + bytesRead2 > 0 ? 1 : 0;
+      buffer2[0] = buffer2[available2];
+    }
+
     // Compare as many bytes as possible
-    auto numberOfBytes = std::min(bytesRead1, bytesRead2);
+    auto numberOfBytes = std::min(bytesRead1, available2);
     bytesTotal += numberOfBytes;
 
     // Count differences
-    for (std::size_t i = 0; i < numberOfBytes; ++i)
-      if (buffer1[i] != buffer2[i])
-        ++bytesDifferent;
+    bytesDifferent += countDifferences(&buffer1[0], data2, numberOfBytes);
 
   } while (file1 && file2);
 
@@ -128,6 +202,258 @@ std::size_t compareFiles(std::istream& file1, std::istream& file2)
 
 /******************************************************************************/
 
+namespace
+{
+  std::string bitSuffix(const MatchResult& result)
+  {
+    return result.bitShift > 0 ? " + " + std::to_string(result.bitShift) + " bit(s)" : "";
+  }
+}
+
+MatchResult analyzeSeam(std::istream& file1, std::istream& file2,
+                        const std::string& fileName2, const SeamOptions& options,
+                        std::vector<MatchResult>* candidates)
+{
+  // Extract last bytes
+  file1.clear();
+  file1.seekg(0, std::ios_base::end);
+  std::uint64_t fileSize1 = file1.tellg();
+  file1.seekg(-static_cast<std::streamoff>(std::min<std::uint64_t>(options.patternSize, fileSize1)), std::ios_base::end);
+
+  std::vector<unsigned char> pattern(
+    (std::istreambuf_iterator<char>(file1)),
+    (std::istreambuf_iterator<char>())
+  );
+
+  // In transport streams, the overlap starts at the same position within a
+  // packet in both files, so only one candidate per packet has to be checked
+  std::size_t stride = 1, phase = 0;
+  if (options.transportStream && !options.bitGranular)
+  {
+    std::size_t packetSize1, packetSize2, grid1, grid2;
+    std::vector<unsigned char> head1(2048), head2(2048);
+
+    auto readHead = [](std::istream& file, std::vector<unsigned char>& head)
+    {
+      file.clear();
+      file.seekg(0);
+      file.read(reinterpret_cast<char*>(&head[0]), head.size());
+      head.resize(file.gcount());
+    };
+
+    readHead(file1, head1);
+    readHead(file2, head2);
+
+    if (findPacketGrid(head1.data(), head1.size(), packetSize1, grid1) &&
+        findPacketGrid(head2.data(), head2.size(), packetSize2, grid2) &&
+        packetSize1 == packetSize2 && fileSize1 >= pattern.size() + grid1)
+    {
+      stride = packetSize1;
+      phase = (grid2 + (fileSize1 - pattern.size() - grid1) % stride) % stride;
+    }
+  }
+
+  // Print pattern for debugging purposes
+  if (options.verbose)
+  {
+    std::cout << "Looking for byte pattern in file " << getFilename(fileName2) << ":\n";
+    for (std::size_t i = 0; i < pattern.size(); ++i)
+    {
+      std::cout << std::hex << std::setfill('0') << std::setw(2)
+                << static_cast<unsigned int>(pattern[i]) << " ";
+    }
+    std::cout << std::dec << std::setfill(' ') << "\n";
+  }
+
+  // Search pattern in second file
+  MatchResult result;
+  MatchResult lastResult = options.bitGranular ? searchBitsInFile(file2, pattern)
+                                                : searchInFile(file2, pattern, 0, stride, phase);
+
+  // Fall back to every position, the files might have lost bytes
+  if (!lastResult.patternFound && stride > 1)
+  {
+    stride = 1;
+    lastResult = searchInFile(file2, pattern);
+  }
+
+  // The overlap may also be compared later on while merging
+  if (!options.compare)
+    result = lastResult;
+
+  if (candidates)
+    candidates->clear();
+
+  // Continue search, remembering best match
+  std::size_t goodMatches = 0;
+  while (lastResult.patternFound && options.compare)
+  {
+    // Clear any stream flags
+    file1.clear();
+    file2.clear();
+
+    // An overlap longer than the first file cannot match at all
+    if (lastResult.overlapCount() > fileSize1)
+      lastResult.bytesDiffering = lastResult.overlapCount();
+    else
+    {
+      // Position file pointers accordingly
+      file1.seekg(-lastResult.overlapCount(), std::ios_base::end);
+      file2.seekg(0);
+
+      // Peform a bytewise comparison of the potentially overlapping area
+      lastResult.bytesDiffering = compareFiles(file1, file2, lastResult.bitShift);
+    }
+
+    // Take this one if quota is higher
+    if (lastResult.quota() > result.quota())
+      result = lastResult;
+
+    // Keep the best few, ordered by quota (impossible overlaps are none)
+    if (candidates && lastResult.quota() > 0)
+    {
+      auto position = std::upper_bound(candidates->begin(), candidates->end(), lastResult,
+                                       [](const MatchResult& a, const MatchResult& b) { return a.quota() > b.quota(); });
+      candidates->insert(position, lastResult);
+      if (candidates->size() > options.candidates)
+        candidates->pop_back();
+    }
+
+    // Abort once sufficiently many good matches were found
+    if (lastResult.quota() > options.minimumQuota)
+      ++goodMatches;
+
+    if (goodMatches >= options.candidates || !options.best)
+      break;
+
+    // Continue from last match position
+    auto previousMatchPos = lastResult.matchPosition;
+    if (options.bitGranular)
+      lastResult = searchBitsInFile(file2, pattern, 8 * previousMatchPos + lastResult.bitShift + 1);
+    else
+      lastResult = searchInFile(file2, pattern, previousMatchPos+1, stride, phase);
+  }
+
+  if (!options.verbose)
+    return result;
+
+  if(!result.patternFound)
+  {
+    std::cout << "Pattern not found\n";
+  }
+  else if (!options.compare)
+  {
+    std::cout << "Found pattern at position " << std::hex
+              << result.matchPosition << std::dec << bitSuffix(result) << '\n';
+  }
+  else
+  {
+    std::cout << "Found pattern at position " << std::hex
+              << result.matchPosition << std::dec << bitSuffix(result) << '\n'
+              << "Overlap match quota: " << std::fixed << std::setprecision(2)
+              << 100.0 * result.quota() << "% ("
+              << result.bytesDiffering << " out of "
+              << result.overlapCount() << " bytes differ)\n";
+
+    if (candidates && candidates->size() > 1)
+      std::cout << candidates->size() << " candidates kept\n";
+  }
+
+  return result;
+}
+
+/******************************************************************************/
+
+std::ostream& operator<<(std::ostream& stream, const MatchResult& result)
+{
+  return stream << result.patternFound << ' ' << result.matchPosition << ' '
+                << result.patternSize << ' ' << result.bytesDiffering;
+}
+
+std::istream& operator>>(std::istream& stream, MatchResult& result)
+{
+  return stream >> result.patternFound >> result.matchPosition
+                >> result.patternSize >> result.bytesDiffering;
+}
+
+/******************************************************************************/
+
+bool savePlan(const std::string& planFileName, const MergePlan& plan)
+{
+  std::ofstream planFile(planFileName);
+
+  planFile << "binmerge-plan 1\n";
+  for (std::size_t i = 0; i < plan.fileNames.size(); ++i)
+    planFile << "file " << plan.fileSizes[i] << ' ' << plan.modificationTimes[i]
+             << ' ' << plan.fileNames[i] << '\n';
+
+  for (const auto& result : plan.searchResults)
+    planFile << "seam " << result << '\n';
+
+  return static_cast<bool>(planFile);
+}
+
+bool loadPlan(const std::string& planFileName, MergePlan& plan)
+{
+  std::ifstream planFile(planFileName);
+
+  std::string header;
+  if (!std::getline(planFile, header) || header != "binmerge-plan 1")
+    return false;
+
+  plan = MergePlan();
+
+  for (std::string type; planFile >> type;)
+  {
+    if (type == "file")
+    {
+      std::uint64_t size;
+      std::int64_t modified;
+      std::string name;
+
+      planFile >> size >> modified;
+      planFile.ignore(1);
+      std::getline(planFile, name);
+
+      plan.fileNames.push_back(name);
+      plan.fileSizes.push_back(size);
+      plan.modificationTimes.push_back(modified);
+    }
+    else if (type == "seam")
+    {
+      MatchResult result;
+      planFile >> result;
+      plan.searchResults.push_back(result);
+    }
+    else
+      return false;
+  }
+
+  return !plan.fileNames.empty() && plan.searchResults.size() + 1 == plan.fileNames.size();
+}
+
+std::vector<Extent> planExtents(const std::vector<std::uint64_t>& fileSizes,
+                                const std::vector<MatchResult>& searchResults)
+{
+  std::vector<Extent> extents;
+  std::uint64_t outputOffset = 0;
+
+  for (std::size_t i = 0; i < fileSizes.size(); ++i)
+  {
+    // Same rule as in mergeFiles(): skip the overlap with the predecessor
+    std::uint64_t skip = 0;
+    if (i > 0 && searchResults[i-1].patternFound)
+      skip = std::min<std::uint64_t>(searchResults[i-1].overlapCount(), fileSizes[i]);
+
+    extents.push_back(Extent{i, skip, outputOffset, fileSizes[i] - skip});
+    outputOffset += fileSizes[i] - skip;
+  }
+
+  return extents;
+}
+
+/******************************************************************************/
+
 std::string getFilename(const std::string& path)
 {
   return path.substr(path.find_last_of("\\") + 1)
@@ -136,6 +462,21 @@ std::string getFilename(const std::string& path)
 
 /******************************************************************************/
 
+// Whether the data the analysis of the seam in front of file i begins with,
+// the tail of its predecessor and its own head, is in the page cache
+bool seamCached(const InputFiles& inputs, std::size_t i)
+{
+  constexpr std::uint64_t window = 4 << 20;
+
+  std::uint64_t tail = std::min(window, inputs.fileSize(i-1));
+  std::uint64_t head = std::min(window, inputs.fileSize(i));
+
+  return inputs.cachedBytes(i-1, inputs.fileSize(i-1) - tail, tail) == tail &&
+         inputs.cachedBytes(i, 0, head) == head;
+}
+
+/******************************************************************************/
+
 void printResults(const std::vector<std::string>& fileNames,
                   const std::vector<MatchResult>& searchResults)
 {
@@ -161,174 +502,1151 @@ void printResults(const std::vector<std::string>& fileNames,
 
 /******************************************************************************/
 
-void mergeFiles(const std::vector<std::string>& fileNames,
-                const std::vector<MatchResult>& searchResults,
-                const std::string& outputFileName)
+bool mergeFiles(InputFiles& inputs,
+                std::vector<MatchResult>& searchResults,
+                const std::vector<std::string>& outputFileNames,
+                const std::vector<MergeSink*>& sinks,
+                const MergeOptions& options)
 {
-    // Create output file and
-    std::ofstream outputFile(outputFileName, std::ios::binary);
-    if(!outputFile)
+    constexpr std::size_t blockSize = 1 << 20;
+
+    // Seams within a byte are spliced bit by bit
+    bool bitLevel = std::any_of(searchResults.begin(), searchResults.end(),
+                                [](const MatchResult& result) { return result.bitShift > 0; });
+    BitWriter bits;
+
+    // If nothing else needs the data, it does not have to pass through here:
+    // the inputs are copied into the output on all worker threads
+    if (!bitLevel && outputFileNames.size() == 1 && sinks.empty() && !options.fusedVerification &&
+        options.splitSize == 0 && options.compressionLevel == 0 && !inputs.anyCompressed() &&
+        copyExtents(inputs.names(), planExtents(inputs.sizes(), searchResults),
+                    outputFileNames.front(), options.threads, options.maxOpen))
+      return true;
+
+    // Create output file(s), several destinations are written concurrently
+    // so that the inputs are still read only once
+    std::vector<std::unique_ptr<MergeSink>> outputs;
+    for (const auto& outputFileName : outputFileNames)
     {
-        std::cerr << "File: " << outputFileName << " failed to open." << '\n';
-        return;
+        std::unique_ptr<MergeSink> output = openOutput(outputFileName, options);
+        if(!output)
+            return false;
+
+        if (outputFileNames.size() > 1)
+            output.reset(new AsyncSink(std::move(output)));
+        outputs.push_back(std::move(output));
     }
 
-    for (int i = 0; i < fileNames.size(); ++i)
+    std::vector<unsigned char> buffer(blockSize), compareBuffer;
+    std::uint64_t outputOffset = 0;
+
+    for (auto sink : sinks)
+      sink->beginMerge(inputs, searchResults);
+
+    for (std::size_t i = 0; i < inputs.size(); ++i)
     {
-      std::ifstream inputFile(fileNames[i], std::ios::binary);
+      std::istream& inputFile = inputs.open(i);
 
       // Basic sanity check
       if (!inputFile)
       {
-        std::cerr << "File: " << fileNames[i] << " failed to open." << '\n';
-        return;
+        std::cerr << "File: " << inputs.name(i) << " failed to open." << '\n';
+        return false;
       }
 
       // If pattern was found in this file, skip the overlapping part
       // The first file will always be copied entirely since it has no predecessor
+      std::size_t seekPosition = 0;
       if (i > 0 && searchResults[i-1].patternFound)
       {
-        auto seekPosition = searchResults[i-1].overlapCount();
-        inputFile.seekg(seekPosition);
+        seekPosition = searchResults[i-1].overlapCount();
+        bits.skip(searchResults[i-1].bitShift);
+      }
+
+      // Streams may be reused from the analysis
+      inputFile.clear();
+      inputFile.seekg(seekPosition);
+
+      for (auto sink : sinks)
+        sink->beginFile(i, outputOffset);
+
+      // In fused mode, the tail overlapping the next file is compared while
+      // copying it. An overlap reaching in front of the file matches nothing.
+      bool fused = options.fusedVerification && i+1 < inputs.size() && searchResults[i].patternFound;
+      bool impossible = fused && searchResults[i].overlapCount() > inputs.fileSize(i);
+      std::uint64_t overlap = fused && !impossible ? searchResults[i].overlapCount() : 0;
+      std::uint64_t tailStart = fused ? std::max<std::uint64_t>(seekPosition, inputs.fileSize(i) - overlap) : ~0ull;
+      std::uint64_t position = seekPosition;
+      std::istream* nextFile = nullptr;
+      std::size_t bytesDiffering = impossible ? searchResults[i].overlapCount() : 0;
+
+      // Copy from current position until the end, passing the data on to all sinks
+      do
+      {
+        std::size_t bytesRequested = position < tailStart ? std::min<std::uint64_t>(blockSize, tailStart - position) : blockSize;
+        inputFile.read(reinterpret_cast<char*>(&buffer[0]), bytesRequested);
+        std::size_t bytesRead = inputFile.gcount();
+
+        if (position >= tailStart && bytesRead > 0)
+        {
+          // Read the matching part of the next file's head alongside
+          if (!nextFile)
+          {
+            nextFile = &inputs.open(i+1);
+            nextFile->seekg(position - (inputs.fileSize(i) - overlap));
+            compareBuffer.resize(blockSize);
+          }
+
+          nextFile->read(reinterpret_cast<char*>(&compareBuffer[0]), bytesRead);
+          std::size_t bytesCompared = nextFile->gcount();
+
+          for (std::size_t k = 0; k < bytesCompared; ++k)
+            bytesDiffering += buffer[k] != compareBuffer[k];
+
+          bytesDiffering += bytesRead - bytesCompared;
+        }
+
+        position += bytesRead;
+
+        const unsigned char* data = &buffer[0];
+        std::size_t length = bytesRead;
+        if (bitLevel)
+          data = bits.append(&buffer[0], bytesRead, length);
+
+        for (auto& output : outputs)
+          output->write(data, length);
+        for (auto sink : sinks)
+          sink->write(data, length);
+
+        outputOffset += length;
+      } while (inputFile);
+
+      // A decoding error ends compressed data early
+      if (inputs.corrupt(i))
+      {
+        std::cerr << "File: " << inputs.name(i) << " is corrupt." << '\n';
+        return false;
+      }
+
+      // The whole tail has been written, so a bad seam turns into a concatenation
+      if (fused)
+      {
+        searchResults[i].bytesDiffering = bytesDiffering;
+
+        if (searchResults[i].quota() < options.minimumQuota)
+        {
+          std::cout << "Overlap of " << getFilename(inputs.name(i)) << " and "
+                    << getFilename(inputs.name(i+1)) << " matches only "
+                    << std::fixed << std::setprecision(2) << 100.0 * searchResults[i].quota()
+                    << "%, concatenating instead\n";
+          searchResults[i] = MatchResult();
+        }
       }
+    }
 
-      // Copy from current position until the end
-      outputFile << inputFile.rdbuf();
+    unsigned char last;
+    if (bits.flush(last))
+    {
+      for (auto& output : outputs)
+        output->write(&last, 1);
+      for (auto sink : sinks)
+        sink->write(&last, 1);
     }
+
+    bool written = true;
+    for (auto& output : outputs)
+      written = output->finish() && written;
+    // Checksum files and indexes must not vouch for an output that failed
+    for (auto sink : sinks)
+      written = written && sink->finish();
+
+    return written;
 }
 
 /******************************************************************************/
 
-int main(int argc, char* argv[])
+int processQueue(const std::string& directory, InputFiles& inputs,
+                 const std::vector<std::string>& outputFileNames, const SeamOptions& seamOptions,
+                 std::chrono::seconds staleAfter, const std::vector<MergeSink*>& sinks,
+                 const MergeOptions& mergeOptions)
 {
-  const char USAGE[] =
-  R"(Merge binary files with possible overlap.
+  // Jobs 0..N-2 analyze the seams, job N-1 merges once all seams are known
+  const std::size_t seamJobs = inputs.size() - 1;
+  const std::size_t mergeJob = seamJobs;
 
-Usage:
-  binmerge [options] [--] <file> <file>...
+  std::vector<std::string> manifest = inputs.names();
+  manifest.insert(manifest.end(), outputFileNames.begin(), outputFileNames.end());
 
-Options:
-  -h --help               Show this screen.
-  --version               Show version.
-  -b, --best              Perform continuous search to find best match.
-  -o FILE, --output FILE  Output file [default: output.bin].
-  )";
+  // Trouble with the shared directory (e.g. one left behind by another job)
+  // ends this worker like any other file error
+  try
+  {
+    WorkQueue queue(directory, manifest, staleAfter);
 
-  auto args = docopt::docopt(USAGE, {argv+1, argv+argc}, true, "binmerge 0.2.0");
+    while (!queue.isDone(0, mergeJob + 1))
+    {
+      std::size_t job;
 
-  //for(auto const& arg : args)
-  //  std::cout << arg.first <<  arg.second << '\n';
+      // Merging requires all seam results, stale claims are taken over on the way
+      bool claimed = queue.claim(job, 0, seamJobs) ||
+                     (queue.isDone(0, seamJobs) && queue.claim(job, mergeJob, mergeJob + 1));
+
+      if (!claimed)
+      {
+        // Wait for other workers to finish (or to become stale)
+        std::this_thread::sleep_for(std::chrono::seconds(1));
+        continue;
+      }
 
-  auto fileNames = args["<file>"].asStringList();
+      Heartbeat heartbeat(queue, job);
 
-  // Open first file
-  std::ifstream file1(fileNames[0], std::ios::binary);
+      if (job < seamJobs)
+      {
+        std::istream& file1 = inputs.open(job);
+        std::istream& file2 = inputs.open(job+1);
 
-    // Basic sanity check
-  if (!file1)
+        // Basic sanity check
+        if (!file1 || !file2)
+        {
+          std::cerr << "File: " << inputs.name(file1 ? job+1 : job) << " failed to open." << '\n';
+          return 1;
+        }
+
+        if (seamOptions.verbose)
+          std::cout << "Seam " << job+1 << " of " << seamJobs << ":\n";
+
+        std::ostringstream result;
+        result << analyzeSeam(file1, file2, inputs.name(job+1), seamOptions);
+
+        if (inputs.corrupt(job) || inputs.corrupt(job+1))
+        {
+          std::cerr << "File: " << inputs.name(inputs.corrupt(job) ? job : job+1) << " is corrupt." << '\n';
+          return 1;
+        }
+
+        queue.complete(job, result.str());
+
+        if (seamOptions.verbose)
+          std::cout << "---------\n";
+      }
+      else
+      {
+        // Collect the results of all workers
+        std::vector<MatchResult> searchResults(seamJobs);
+        for (std::size_t i = 0; i < seamJobs; ++i)
+        {
+          std::istringstream result(queue.result(i));
+          result >> searchResults[i];
+        }
+
+        if (!mergeFiles(inputs, searchResults, outputFileNames, sinks, mergeOptions))
+          return 1;
+
+        printResults(inputs.names(), searchResults);
+        queue.complete(job, outputFileNames.front());
+      }
+    }
+  }
+  catch (const std::exception& error)
   {
-    std::cerr << "File: " << fileNames[0] << " failed to open." << '\n';
+    std::cerr << "Queue: " << error.what() << '.' << '\n';
     return 1;
   }
 
-  std::vector<MatchResult> searchResults;
+  return 0;
+}
 
-  for (int i = 1; i < fileNames.size(); ++i)
-  {
-    // Extract last 20 bytes
-    file1.clear();
-    file1.seekg(-20, std::ios_base::end);
+/******************************************************************************/
 
-    std::vector<unsigned char> pattern(
-      (std::istreambuf_iterator<char>(file1)),
-      (std::istreambuf_iterator<char>())
-    );
+int updateMerge(InputFiles& inputs, const MergePlan& plan, const std::vector<bool>& changedFiles,
+                const std::string& planFileName, const std::vector<std::string>& outputFileNames,
+                SeamOptions seamOptions)
+{
+  // Quotas are needed in the plan, so overlaps are always compared here
+  seamOptions.compare = true;
 
-    // Print pattern for debugging purposes
-    std::cout << "Looking for byte pattern in file " << getFilename(fileNames[i]) << ":\n";
-    for (std::size_t i = 0; i < pattern.size(); ++i)
-    {
-      std::cout << std::hex << std::setfill('0') << std::setw(2)
-                << static_cast<unsigned int>(pattern[i]) << " ";
-    }
-    std::cout << std::dec << std::setfill(' ') << "\n";
+  // Only the seams next to a changed file have to be analyzed again
+  std::vector<MatchResult> searchResults = plan.searchResults;
+  for (std::size_t i = 0; i + 1 < inputs.size(); ++i)
+  {
+    if (!changedFiles[i] && !changedFiles[i+1])
+      continue;
 
-    // Open next file
-    std::ifstream file2(fileNames[i], std::ios::binary);
+    std::istream& file1 = inputs.open(i);
+    std::istream& file2 = inputs.open(i+1);
 
     // Basic sanity check
-    if (!file2)
+    if (!file1 || !file2)
     {
-      std::cerr << "File: " << fileNames[i] << " failed to open." << '\n';
+      std::cerr << "File: " << inputs.name(file1 ? i+1 : i) << " failed to open." << '\n';
       return 1;
     }
 
-    // Search pattern in second file
-    MatchResult result;
-    MatchResult lastResult = searchInFile(file2, pattern);
+    if (seamOptions.verbose)
+      std::cout << "Seam " << i+1 << " of " << inputs.size()-1 << ":\n";
 
-    // Continue search, remembering best match
-    while (lastResult.patternFound)
-    {
-      // Clear any stream flags
-      file1.clear();
-      file2.clear();
+    searchResults[i] = analyzeSeam(file1, file2, inputs.name(i+1), seamOptions);
 
-      // Position file pointers accordingly
-      file1.seekg(-lastResult.overlapCount(), std::ios_base::end);
-      file2.seekg(0);
+    if (seamOptions.verbose)
+      std::cout << "---------\n";
+  }
 
-      // Peform a bytewise comparison of the potentially overlapping area
-      lastResult.bytesDiffering = compareFiles(file1, file2);
+  auto oldExtents = planExtents(plan.fileSizes, plan.searchResults);
+  auto newExtents = planExtents(inputs.sizes(), searchResults);
 
-      // Take this one if quota is higher
-      if (lastResult.quota() > result.quota())
-        result = lastResult;
+  for (const auto& outputFileName : outputFileNames)
+    if (!updateOutput(inputs.names(), oldExtents, newExtents, changedFiles, outputFileName))
+      return 1;
 
-      // Abort if quota is sufficiently high (TODO: make this a user setting)
-      if (result.quota() > 0.7 || !args["--best"].asBool())
-        break;
+  // The plan now describes the updated output
+  if (!savePlan(planFileName, MergePlan{inputs.names(), inputs.sizes(), inputs.modificationTimes(), searchResults}))
+  {
+    std::cerr << "File: " << planFileName << " failed to open." << '\n';
+    return 1;
+  }
 
-      // Continue from last match position
-      auto previousMatchPos = lastResult.matchPosition;
-      lastResult = searchInFile(file2, pattern, previousMatchPos+1);
-    }
+  printResults(inputs.names(), searchResults);
+  return 0;
+}
 
-    searchResults.push_back(result);
+/******************************************************************************/
 
-    if(!result.patternFound)
-    {
-      std::cout << "Pattern not found\n";
-    }
-    else
+int repairFile(InputFiles& inputs, const RepairOptions& repairOptions, const std::string& planFileName,
+               const std::vector<std::string>& outputFileNames, const MergeOptions& mergeOptions,
+               bool yes, bool verify, unsigned threads)
+{
+  const auto& fileName = inputs.name(0);
+
+  std::vector<Duplicate> duplicates;
+  if (!findDuplicates(fileName, repairOptions, duplicates))
+    return 1;
+
+  std::uint64_t duplicatedBytes = 0;
+  for (const auto& duplicate : duplicates)
+  {
+    std::cout << "Duplicate of " << duplicate.length << " bytes at offset " << duplicate.offset << '\n';
+    duplicatedBytes += duplicate.length;
+  }
+
+  std::cout << "Found " << duplicates.size() << " duplicate(s), "
+            << duplicatedBytes << " bytes in total\n";
+
+  // The plan allows collapsing the duplicates in place instead of copying
+  if (!planFileName.empty())
+  {
+    if (!saveRepairPlan(planFileName, fileName, inputs.fileSize(0), inputs.modificationTime(0), duplicates))
     {
-      std::cout << "Found pattern at position " << std::hex
-                << result.matchPosition << std::dec << '\n'
-                << "Overlap match quota: " << std::fixed << std::setprecision(2)
-                << 100.0 * result.quota() << "% ("
-                << result.bytesDiffering << " out of "
-                << result.overlapCount() << " bytes differ)\n";
+      std::cerr << "File: " << planFileName << " failed to open." << '\n';
+      return 1;
     }
+    return 0;
+  }
 
-    std::cout << "---------\n";
+  if (duplicates.empty())
+    return 0;
 
-    file1.swap(file2); // alternatively, file1 = std::move(file2)
+  if (std::count(outputFileNames.begin(), outputFileNames.end(), fileName))
+  {
+    std::cerr << "File: " << fileName << " cannot be repaired onto itself." << '\n';
+    return 1;
   }
 
-  file1.close();
+  char decision = 'y';
+  if (!yes)
+  {
+    std::cout << "Write repaired file (y/n)? ";
+    std::cin >> decision;
+  }
 
-  printResults(fileNames, searchResults);
+  if (decision != 'y' && decision != 'Y')
+    return 0;
 
-  std::cout << "\nMatching files will be merged accordingly (regardless of quota),\n"
-            << "while non-matching files will simply be concatenated.\n";
+  auto extents = repairExtents(inputs.fileSize(0), duplicates);
+  if (!writeExtents(inputs.names(), extents, outputFileNames, mergeOptions))
+    return 1;
 
-  // Merge files if requested
-  char decision;
-  std::cout << "Merge files (y/n)? ";
-  std::cin >> decision;
+  if (verify)
+    for (const auto& outputFileName : outputFileNames)
+      if (!verifyOutput(inputs.names(), extents, outputFileName, threads))
+        return 1;
+
+  return 0;
+}
+
+/******************************************************************************/
+
+int combineFiles(InputFiles& inputs, const CombineOptions& combineOptions,
+                 const std::vector<std::string>& outputFileNames, const std::vector<MergeSink*>& sinks,
+                 const MergeOptions& mergeOptions, bool yes)
+{
+  std::vector<std::uint64_t> starts;
+  if (!alignRecordings(inputs, combineOptions, starts))
+    return 1;
+
+  for (std::size_t i = 0; i < inputs.size(); ++i)
+    std::cout << "File: " << inputs.name(i) << " starts at output offset " << starts[i] << '\n';
+
+  char decision = 'y';
+  if (!yes)
+  {
+    std::cout << "Combine files (y/n)? ";
+    std::cin >> decision;
+  }
+
+  if (decision != 'y' && decision != 'Y')
+    return 0;
+
+  return combineRecordings(inputs, starts, outputFileNames, sinks, combineOptions, mergeOptions) ? 0 : 1;
+}
+
+/******************************************************************************/
+
+int clusterAndMerge(const std::vector<std::string>& fileNames, const ClusterOptions& clusterOptions,
+                    const std::string& directory, const MergeOptions& mergeOptions, bool yes, bool verify)
+{
+  std::vector<Chain> chains = clusterFiles(fileNames, clusterOptions);
+
+  // Single files overlap with nothing, they are left alone
+  std::vector<Chain> recordings;
+  std::vector<std::string> outputFileNames;
+
+  for (auto& chain : chains)
+  {
+    if (chain.fileNames.size() < 2)
+    {
+      std::cout << "File: " << chain.fileNames[0] << " does not overlap with any other file\n";
+      continue;
+    }
 
-  if (decision == 'y' || decision == 'Y')
-    mergeFiles(fileNames, searchResults, args["--output"].asString());
+    std::string outputFileName = directory + "/" + getFilename(chain.fileNames[0]);
+    if (std::count(fileNames.begin(), fileNames.end(), outputFileName))
+    {
+      std::cerr << "File: " << outputFileName << " would be overwritten by its own recording." << '\n';
+      return 1;
+    }
+
+    // Recordings are named after their first files, which may share a name
+    if (std::count(outputFileNames.begin(), outputFileNames.end(), outputFileName))
+    {
+      std::cerr << "File: " << outputFileName << " would be written by two recordings." << '\n';
+      return 1;
+    }
+
+    std::cout << "\nRecording " << recordings.size() + 1 << " -> " << outputFileName << '\n';
+    printResults(chain.fileNames, chain.searchResults);
+
+    recordings.push_back(std::move(chain));
+    outputFileNames.push_back(outputFileName);
+  }
+
+  if (recordings.empty())
+    return 0;
+
+  char decision = 'y';
+  if (!yes)
+  {
+    std::cout << "Merge " << recordings.size() << " recording(s) (y/n)? ";
+    std::cin >> decision;
+  }
+
+  if (decision != 'y' && decision != 'Y')
+    return 0;
+
+  return mergeChains(recordings, outputFileNames, mergeOptions, verify) ? 0 : 1;
+}
+
+/******************************************************************************/
+
+int extractClip(InputFiles& inputs, const TimeRange& range, const SeamOptions& seamOptions,
+                std::vector<MatchResult> searchResults, const std::vector<std::string>& outputFileNames,
+                const MergeOptions& mergeOptions, bool yes, bool verify)
+{
+  std::vector<Extent> extents;
+  if (!locateTimeRange(inputs, range, seamOptions, searchResults, extents))
+    return 1;
+
+  std::uint64_t clipSize = 0;
+  for (const auto& extent : extents)
+  {
+    std::cout << "File: " << getFilename(inputs.name(extent.file)) << " bytes " << extent.sourceOffset
+              << " to " << extent.sourceOffset + extent.length << '\n';
+    clipSize += extent.length;
+  }
+
+  std::cout << "Clip of " << clipSize << " bytes\n";
+
+  char decision = 'y';
+  if (!yes)
+  {
+    std::cout << "Extract clip (y/n)? ";
+    std::cin >> decision;
+  }
+
+  if (decision != 'y' && decision != 'Y')
+    return 0;
+
+  if (!writeExtents(inputs.names(), extents, outputFileNames, mergeOptions))
+    return 1;
+
+  if (verify)
+    for (const auto& outputFileName : outputFileNames)
+      if (!verifyOutput(inputs.names(), extents, outputFileName, mergeOptions.threads))
+        return 1;
+
+  return 0;
+}
+
+/******************************************************************************/
+
+// Parses a whole number within [minimum, maximum]
+bool parseNumber(const std::string& text, long minimum, long maximum, long& number)
+{
+  std::istringstream stream(text);
+  return stream >> number && stream.get() == EOF && number >= minimum && number <= maximum;
+}
+
+// Parses a byte count with an optional K, M or G suffix (powers of 1024)
+bool parseSize(const std::string& text, std::uint64_t& size)
+{
+  std::istringstream stream(text);
+  char suffix = 0;
+
+  if (!(stream >> size) || size == 0)
+    return false;
+
+  if (stream >> suffix)
+  {
+    const std::string suffixes = "KMG";
+    auto exponent = suffixes.find(std::toupper(suffix));
+    if (exponent == std::string::npos || stream.get() != EOF)
+      return false;
+
+    size <<= 10 * (exponent + 1);
+  }
+
+  return true;
+}
+
+/******************************************************************************/
+
+int main(int argc, char* argv[])
+{
+  const char USAGE[] =
+  R"(Merge binary files with possible overlap.
+
+Usage:
+  binmerge [options] [-o FILE]... [--] <file>...
+  binmerge [options] [-o FILE]... --plan FILE
+  binmerge [options] [-o FILE]... --repair FILE
+
+Options:
+  -h --help               Show this screen.
+  --version               Show version.
+  -b, --best              Perform continuous search to find best match.
+  --min-quota PERCENT     Quota of a good match, at which the continuous
+                          search stops [default: 70].
+  --candidates K          With --best, keep the K best matches of every seam
+                          and choose among them the ones that fit the whole
+                          chain best (overlaps of similar size) [default: 1].
+  --pattern-size N        Number of bytes at the end of a file searched for
+                          in its successor (4-4096) [default: 20].
+  --fused                 Compare overlaps while merging instead of during
+                          the analysis, so that they are read only once;
+                          seams below the minimum quota are concatenated.
+  -o FILE, --output FILE  Output file, may be given several times to write
+                          the same data to each [default: output.bin].
+  -y, --yes               Merge without asking for confirmation.
+  -q, --quiet             Do not print details of every seam.
+  --max-open N            Maximum number of simultaneously open input
+                          files [default: 64].
+  --checksum LIST         Compute digests of the output while merging and
+                          store them next to it (comma separated list of
+                          xxh3, blake3, sha256).
+  -j N, --jobs N          Number of worker threads, 0 for one per CPU
+                          [default: 0].
+  --save-plan FILE        Store the input files and seams in FILE.
+  --plan FILE             Take input files and seams from FILE (written by
+                          --save-plan) instead of analyzing the files.
+  --verify                Check the output against the inputs after
+                          merging, or instead of merging with --plan.
+  --update                Bring the output of --plan up to date after some
+                          input files changed, rewriting only what differs;
+                          the plan is updated as well.
+  --repair FILE           Remove duplicated overlaps from a file of naively
+                          concatenated segments; with --save-plan, only
+                          list them in the given file.
+  --min-duplicate SIZE    Shortest overlap removed by --repair
+                          [default: 4K].
+  --max-duplicate SIZE    Longest overlap found by --repair [default: 64M].
+  --trim-in-place         Instead of merging, remove the overlaps from the
+                          input files themselves (from the predecessor's
+                          tail), so that they can simply be concatenated.
+  --trim-heads            Trim the overlaps from the heads of the files as
+                          far as the file system can collapse them.
+  --cluster DIR           Sort the files into independent recordings (chains
+                          of overlapping segments) and merge each of them
+                          into DIR, named after its first file.
+  --max-overlap SIZE      Longest overlap found when sorting files into
+                          recordings [default: 16M].
+  --combine               Treat the files as simultaneous recordings of the
+                          same stream and combine them into one, taking
+                          each byte by majority (gaps and bit errors in
+                          single recordings are outvoted).
+  --max-gap SIZE          Longest gap in a recording, or difference between
+                          the starts of two recordings, that is bridged
+                          when combining them [default: 64M].
+  --bits                  Find overlaps starting at any bit, for captures
+                          split within bytes, and join the files bit by bit.
+  --ts                    Treat the files as MPEG transport streams.
+  --ts-stats              Count continuity errors, transport errors and PCR
+                          jumps per PID, file and seam while merging.
+  --split-size SIZE       Write the output as numbered parts of at most SIZE
+                          bytes (suffixes K, M, G), cut at packet
+                          boundaries with --ts.
+  --compress zstd[:LEVEL] Compress the output in the seekable zstd format
+                          on all worker threads (LEVEL 1-22, default 3).
+  --index                 Write an index of segments and seams (and PCRs
+                          with --ts) to the output file name plus ".idx".
+  --extract FROM-TO       Write only the part of a transport stream recording
+                          between two times ([[HH:]MM:]SS[.fraction] since
+                          its first PCR), reading little more than that.
+  --estimate              Predict the bytes read and written, the memory and
+                          the time of the job instead of running it (the
+                          storage is probed with a few MiB).
+  --queue DIR             Share analysis and merge with other binmerge
+                          processes through a work queue in DIR.
+  --stale SECONDS         Take over queue jobs whose worker has not sent a
+                          heartbeat for SECONDS (at least 4) [default: 60].
+  )";
+
+  // Only C++ streams are used, they need not be synchronized with stdio
+  std::ios::sync_with_stdio(false);
+
+  // docopt is only needed for the more elaborate command lines
+  std::vector<std::string> arguments(argv+1, argv+argc);
+  std::map<std::string, docopt::value> args;
+
+  if (!parseSimpleArguments(USAGE, arguments, args))
+    args = docopt::docopt(USAGE, arguments, true, "binmerge 0.2.0");
+
+  //for(auto const& arg : args)
+  //  std::cout << arg.first <<  arg.second << '\n';
+
+  // Either continue from a previous analysis or take the given files
+  MergePlan plan;
+  if (args["--plan"] && !loadPlan(args["--plan"].asString(), plan))
+  {
+    std::cerr << "File: " << args["--plan"].asString() << " is not a valid plan." << '\n';
+    return 1;
+  }
+
+  // Directories and glob patterns may stand for many (naturally sorted) files
+  std::vector<std::string> inputNames;
+  if (args["--repair"])
+    inputNames.push_back(args["--repair"].asString());
+  else if (args["--plan"])
+    inputNames = plan.fileNames;
+  else
+    inputNames = expandInputs(args["<file>"].asStringList());
+
+  long maxOpen;
+  if (!parseNumber(args["--max-open"].asString(), 2, 1 << 20, maxOpen))
+  {
+    std::cerr << "Invalid number of open files: " << args["--max-open"].asString() << '\n';
+    return 1;
+  }
+
+  InputFiles inputs(inputNames, maxOpen);
+  auto& fileNames = inputs.names();
+
+  if (fileNames.size() < 2 && !args["--repair"])
+  {
+    std::cerr << "At least two input files are required." << '\n';
+    return 1;
+  }
+
+  for (std::size_t i = 0; i < fileNames.size(); ++i)
+  {
+    if (!compressionSupported(inputs.compression(i)))
+    {
+      std::cerr << "File: " << fileNames[i] << " is compressed, but binmerge was built without support for it." << '\n';
+      return 1;
+    }
+
+    if (inputs.corrupt(i))
+    {
+      std::cerr << "File: " << fileNames[i] << " is corrupt." << '\n';
+      return 1;
+    }
+  }
+
+  // Working on the files themselves requires them to be uncompressed
+  if (inputs.anyCompressed() && (args["--verify"].asBool() || args["--update"].asBool() ||
+                                 args["--trim-in-place"].asBool() || args["--repair"]))
+  {
+    std::cerr << "--verify, --update, --trim-in-place and --repair do not support compressed files." << '\n';
+    return 1;
+  }
+
+  auto outputFileNames = args["--output"].asStringList();
+
+  for (std::size_t i = 0; i < outputFileNames.size(); ++i)
+  {
+    if (std::count(outputFileNames.begin(), outputFileNames.begin() + i, outputFileNames[i]))
+    {
+      std::cerr << "File: " << outputFileNames[i] << " is given more than once." << '\n';
+      return 1;
+    }
+  }
+
+  SeamOptions seamOptions;
+  seamOptions.best = args["--best"].asBool();
+  seamOptions.compare = !args["--fused"].asBool();
+  seamOptions.verbose = !args["--quiet"].asBool();
+  seamOptions.transportStream = args["--ts"].asBool();
+  seamOptions.bitGranular = args["--bits"].asBool();
+
+  long minimumQuota;
+  if (!parseNumber(args["--min-quota"].asString(), 0, 100, minimumQuota))
+  {
+    std::cerr << "Invalid quota: " << args["--min-quota"].asString() << '\n';
+    return 1;
+  }
+  seamOptions.minimumQuota = minimumQuota / 100.0;
+
+  long patternSize;
+  if (!parseNumber(args["--pattern-size"].asString(), 4, 4096, patternSize))
+  {
+    std::cerr << "Invalid pattern size: " << args["--pattern-size"].asString() << '\n';
+    return 1;
+  }
+  seamOptions.patternSize = patternSize;
+
+  long candidates;
+  if (!parseNumber(args["--candidates"].asString(), 1, 64, candidates))
+  {
+    std::cerr << "Invalid number of candidates: " << args["--candidates"].asString() << '\n';
+    return 1;
+  }
+  seamOptions.candidates = candidates;
+
+  // The choice needs the quotas of all candidates of all seams at once
+  if (candidates > 1 &&
+      (!seamOptions.best || args["--fused"].asBool() || args["--plan"] || args["--queue"] ||
+       args["--cluster"] || args["--combine"].asBool() || args["--extract"]))
+  {
+    std::cerr << "--candidates requires --best and cannot be combined with --fused, --plan, --queue,"
+              << " --cluster, --combine or --extract." << '\n';
+    return 1;
+  }
+
+  MergeOptions mergeOptions;
+  mergeOptions.fusedVerification = args["--fused"].asBool();
+  mergeOptions.minimumQuota = seamOptions.minimumQuota;
+  mergeOptions.packetAligned = args["--ts"].asBool();
+
+  if (args["--split-size"] && !parseSize(args["--split-size"].asString(), mergeOptions.splitSize))
+  {
+    std::cerr << "Invalid split size: " << args["--split-size"].asString() << '\n';
+    return 1;
+  }
+
+  if (args["--trim-in-place"].asBool() && mergeOptions.fusedVerification)
+  {
+    std::cerr << "--trim-in-place needs the quotas of the analysis and cannot be combined with --fused." << '\n';
+    return 1;
+  }
+
+  if (seamOptions.best && mergeOptions.fusedVerification)
+  {
+    std::cerr << "--best needs the quotas of the analysis and cannot be combined with --fused." << '\n';
+    return 1;
+  }
+
+  if (args["--compress"])
+  {
+    std::string method = args["--compress"].asString();
+    std::size_t colon = method.find(':');
+    mergeOptions.compressionLevel = colon == std::string::npos ? 3 : std::atoi(method.c_str() + colon + 1);
+
+    if (method.substr(0, colon) != "zstd" || mergeOptions.compressionLevel < 1 || mergeOptions.compressionLevel > 22)
+    {
+      std::cerr << "Unknown compression: " << method << '\n';
+      return 1;
+    }
+
+    // Checksum files name the output, but the digests would be those of the uncompressed data
+    if (mergeOptions.splitSize > 0 || args["--verify"].asBool() || args["--update"].asBool() || args["--checksum"])
+    {
+      std::cerr << "--compress cannot be combined with --split-size, --verify, --update or --checksum." << '\n';
+      return 1;
+    }
+  }
+
+  // Plans, extents and packets are made of whole bytes
+  if (seamOptions.bitGranular &&
+      (args["--ts"].asBool() || args["--fused"].asBool() || args["--verify"].asBool() || args["--plan"] ||
+       args["--save-plan"] || args["--update"].asBool() || args["--trim-in-place"].asBool() || args["--repair"] ||
+       args["--combine"].asBool() || args["--cluster"] || args["--extract"] || args["--index"].asBool() ||
+       args["--queue"]))
+  {
+    std::cerr << "--bits cannot be combined with --ts, --fused, --verify, --plan, --save-plan, --update,"
+              << " --trim-in-place, --repair, --combine, --cluster, --extract, --index or --queue." << '\n';
+    return 1;
+  }
+
+  if (mergeOptions.splitSize > 0 && args["--verify"].asBool())
+  {
+    std::cerr << "--verify cannot be combined with --split-size." << '\n';
+    return 1;
+  }
+
+  // More threads than that only add overhead, whatever the machine
+  constexpr long maximumThreads = 1024;
+
+  long jobs;
+  if (!parseNumber(args["--jobs"].asString(), 0, LONG_MAX, jobs))
+  {
+    std::cerr << "Invalid number of threads: " << args["--jobs"].asString() << '\n';
+    return 1;
+  }
+
+  unsigned threads = std::min(jobs, maximumThreads);
+  if (threads == 0)
+    threads = std::max(1u, std::thread::hardware_concurrency());
+
+  mergeOptions.threads = threads;
+  mergeOptions.maxOpen = maxOpen;
+
+  // Only predict what merging (or verifying) would cost
+  if (args["--estimate"].asBool())
+  {
+    if (args["--repair"] || args["--update"].asBool() || args["--combine"].asBool() || args["--cluster"] ||
+        args["--extract"] || args["--trim-in-place"].asBool() || args["--queue"])
+    {
+      std::cerr << "--estimate cannot be combined with --repair, --update, --combine, --cluster,"
+                << " --extract, --trim-in-place or --queue." << '\n';
+      return 1;
+    }
+
+    bool hasSinks = args["--checksum"] || args["--index"].asBool() || args["--ts-stats"].asBool();
+    printEstimate(std::cout, estimateJob(inputs, args["--plan"] ? &plan.searchResults : nullptr,
+                                         outputFileNames, seamOptions, mergeOptions, hasSinks,
+                                         args["--verify"].asBool()));
+    return 0;
+  }
+
+  if (args["--repair"])
+  {
+    RepairOptions repairOptions;
+    if (!parseSize(args["--min-duplicate"].asString(), repairOptions.minimumLength) ||
+        !parseSize(args["--max-duplicate"].asString(), repairOptions.maximumLength))
+    {
+      std::cerr << "Invalid duplicate size." << '\n';
+      return 1;
+    }
+
+    return repairFile(inputs, repairOptions, args["--save-plan"] ? args["--save-plan"].asString() : "",
+                      outputFileNames, mergeOptions, args["--yes"].asBool(),
+                      args["--verify"].asBool(), threads);
+  }
+
+  // A plan is only valid as long as the files do not change, unless the
+  // output is updated accordingly
+  std::vector<bool> changedFiles(plan.fileNames.size());
+  bool update = args["--update"].asBool();
+
+  for (std::size_t i = 0; i < plan.fileNames.size(); ++i)
+  {
+    changedFiles[i] = inputs.fileSize(i) != plan.fileSizes[i] ||
+                      inputs.modificationTime(i) != plan.modificationTimes[i];
+
+    if (changedFiles[i] && !update)
+    {
+      std::cerr << "File: " << fileNames[i] << " changed since the plan was made." << '\n';
+      return 1;
+    }
+  }
+
+  if (update)
+  {
+    if (!args["--plan"] || args["--checksum"] || args["--index"].asBool() || args["--split-size"])
+    {
+      std::cerr << "--update requires --plan and cannot be combined with --checksum, --index"
+                << " or --split-size." << '\n';
+      return 1;
+    }
+
+    return updateMerge(inputs, plan, changedFiles, args["--plan"].asString(),
+                       outputFileNames, seamOptions);
+  }
+
+  // A clip only needs the seams within it
+  if (args["--extract"])
+  {
+    TimeRange range;
+    if (!parseTimeRange(args["--extract"].asString(), range))
+    {
+      std::cerr << "Invalid time range: " << args["--extract"].asString() << '\n';
+      return 1;
+    }
+
+    if (args["--save-plan"] || args["--fused"].asBool() || args["--combine"].asBool() || args["--cluster"] ||
+        args["--trim-in-place"].asBool() || args["--checksum"] || args["--index"].asBool() ||
+        args["--ts-stats"].asBool() || args["--queue"] || inputs.anyCompressed())
+    {
+      std::cerr << "--extract cannot be combined with --save-plan, --fused, --combine, --cluster,"
+                << " --trim-in-place, --checksum, --index, --ts-stats, --queue or compressed files." << '\n';
+      return 1;
+    }
+
+    SeamOptions clipOptions = seamOptions;
+    clipOptions.transportStream = true;
+
+    return extractClip(inputs, range, clipOptions, plan.searchResults, outputFileNames, mergeOptions,
+                       args["--yes"].asBool(), args["--verify"].asBool());
+  }
+
+  // Every output is checked, even if an earlier one failed
+  auto verifyOutputs = [&](const std::vector<MatchResult>& searchResults)
+  {
+    auto extents = planExtents(inputs.sizes(), searchResults);
+    bool verified = true;
+
+    for (const auto& outputFileName : outputFileNames)
+      verified = verifyOutput(fileNames, extents, outputFileName, threads) && verified;
+
+    return verified;
+  };
+
+  if (args["--plan"] && args["--verify"].asBool())
+    return verifyOutputs(plan.searchResults) ? 0 : 1;
+
+  // Collect everything that consumes the merged data besides the output file
+  std::vector<std::unique_ptr<MergeSink>> sinkStorage;
+
+  if (args["--checksum"])
+  {
+    std::vector<std::unique_ptr<Digest>> digests;
+    std::istringstream list(args["--checksum"].asString());
+
+    for (std::string name; std::getline(list, name, ',');)
+    {
+      digests.push_back(makeDigest(name));
+      if (!digests.back())
+      {
+        std::cerr << "Unknown checksum: " << name << '\n';
+        return 1;
+      }
+    }
+
+    sinkStorage.emplace_back(new DigestSink(std::move(digests), outputFileNames));
+  }
+
+  if (args["--index"].asBool())
+    sinkStorage.emplace_back(new IndexSink(outputFileNames, args["--ts"].asBool()));
+
+  if (args["--ts-stats"].asBool())
+    sinkStorage.emplace_back(new TsStatsSink);
+
+  std::vector<MergeSink*> sinks;
+  for (auto& sink : sinkStorage)
+    sinks.push_back(sink.get());
+
+  // Unrelated recordings are told apart by their overlaps
+  if (args["--cluster"])
+  {
+    ClusterOptions clusterOptions;
+    clusterOptions.seamOptions = seamOptions;
+    clusterOptions.threads = threads;
+
+    if (!parseSize(args["--max-overlap"].asString(), clusterOptions.maximumOverlap))
+    {
+      std::cerr << "Invalid overlap size: " << args["--max-overlap"].asString() << '\n';
+      return 1;
+    }
+
+    if (args["--plan"] || args["--save-plan"] || args["--combine"].asBool() || args["--trim-in-place"].asBool() ||
+        !sinks.empty() || args["--queue"] || inputs.anyCompressed())
+    {
+      std::cerr << "--cluster cannot be combined with --plan, --save-plan, --combine, --trim-in-place,"
+                << " --checksum, --index, --ts-stats, --queue or compressed files." << '\n';
+      return 1;
+    }
+
+    return clusterAndMerge(fileNames, clusterOptions, args["--cluster"].asString(), mergeOptions,
+                           args["--yes"].asBool(), args["--verify"].asBool());
+  }
+
+  // Redundant recordings are not merged one after the other, but all at once
+  if (args["--combine"].asBool())
+  {
+    CombineOptions combineOptions;
+    combineOptions.patternSize = seamOptions.patternSize;
+    combineOptions.verbose = seamOptions.verbose;
+
+    if (!parseSize(args["--max-gap"].asString(), combineOptions.maximumGap))
+    {
+      std::cerr << "Invalid gap size: " << args["--max-gap"].asString() << '\n';
+      return 1;
+    }
+
+    if (args["--plan"] || args["--save-plan"] || args["--verify"].asBool() || args["--fused"].asBool() ||
+        args["--trim-in-place"].asBool() || args["--index"].asBool() || args["--queue"])
+    {
+      std::cerr << "--combine cannot be combined with --plan, --save-plan, --verify, --fused,"
+                << " --trim-in-place, --index or --queue." << '\n';
+      return 1;
+    }
+
+    // The recordings are read side by side
+    if (fileNames.size() > static_cast<std::size_t>(maxOpen) || inputs.anyCompressed())
+    {
+      std::cerr << "--combine needs all files to be uncompressed and open at once (see --max-open)." << '\n';
+      return 1;
+    }
+
+    return combineFiles(inputs, combineOptions, outputFileNames, sinks, mergeOptions, args["--yes"].asBool());
+  }
+
+  // Cooperate with other processes on the same job
+  if (args["--queue"])
+  {
+    // Claims are refreshed every quarter of the timeout, at most every
+    // second, so shorter timeouts would take over jobs of live workers
+    long staleAfter;
+    if (!parseNumber(args["--stale"].asString(), 4, 7 * 24 * 3600, staleAfter))
+    {
+      std::cerr << "Invalid stale timeout: " << args["--stale"].asString() << '\n';
+      return 1;
+    }
+
+    return processQueue(args["--queue"].asString(), inputs, outputFileNames, seamOptions,
+                        std::chrono::seconds(staleAfter), sinks, mergeOptions);
+  }
+
+  std::vector<MatchResult> searchResults = plan.searchResults;
+  std::size_t seamsKnown = searchResults.size();
+  searchResults.resize(fileNames.size() - 1);
+
+  // Seams whose data is still in the page cache (e.g. segments just written
+  // by the recorder) are nearly free and go first. The others follow in file
+  // order, so that the cold reads proceed through the files one by one.
+  std::vector<std::vector<MatchResult>> seamCandidates(searchResults.size());
+  std::vector<std::size_t> seamOrder;
+  for (std::size_t i = seamsKnown + 1; i < fileNames.size(); ++i)
+    seamOrder.push_back(i);
+
+  auto cold = std::stable_partition(seamOrder.begin(), seamOrder.end(),
+                                    [&](std::size_t i) { return seamCached(inputs, i); });
+
+  if (seamOptions.verbose && cold != seamOrder.begin() && cold != seamOrder.end())
+    std::cout << "Analyzing " << cold - seamOrder.begin() << " seam(s) with cached data first\n";
+
+  for (auto i : seamOrder)
+  {
+    // Open both files (the previous one is usually still cached)
+    std::istream& file1 = inputs.open(i-1);
+    std::istream& file2 = inputs.open(i);
+
+    // Basic sanity check
+    if (!file1 || !file2)
+    {
+      std::cerr << "File: " << fileNames[file1 ? i : i-1] << " failed to open." << '\n';
+      return 1;
+    }
+
+    searchResults[i-1] = analyzeSeam(file1, file2, fileNames[i], seamOptions,
+                                     seamOptions.candidates > 1 ? &seamCandidates[i-1] : nullptr);
+
+    if (inputs.corrupt(i-1) || inputs.corrupt(i))
+    {
+      std::cerr << "File: " << fileNames[inputs.corrupt(i-1) ? i-1 : i] << " is corrupt." << '\n';
+      return 1;
+    }
+
+    if (seamOptions.verbose)
+      std::cout << "---------\n";
+  }
+
+  // Ambiguous seams are decided by the chain as a whole
+  if (seamOptions.candidates > 1)
+  {
+    std::vector<MatchResult> chosen = chooseConsistentSeams(seamCandidates);
+
+    for (std::size_t i = 0; i < chosen.size(); ++i)
+    {
+      if (chosen[i].overlapCount() != searchResults[i].overlapCount() && seamOptions.verbose)
+        std::cout << "Seam " << i+1 << ": overlap of " << chosen[i].overlapCount() << " bytes ("
+                  << std::fixed << std::setprecision(2) << 100.0 * chosen[i].quota() << "%) instead of "
+                  << searchResults[i].overlapCount() << " bytes (" << 100.0 * searchResults[i].quota()
+                  << "%) fits the other seams better\n";
+    }
+
+    searchResults = chosen;
+  }
+
+  auto reportResults = [&]
+  {
+    printResults(fileNames, searchResults);
+
+    if (args["--save-plan"] &&
+        !savePlan(args["--save-plan"].asString(),
+                  MergePlan{fileNames, inputs.sizes(), inputs.modificationTimes(), searchResults}))
+    {
+      std::cerr << "File: " << args["--save-plan"].asString() << " failed to open." << '\n';
+      return false;
+    }
+
+    return true;
+  };
+
+  // With fused verification, the quotas are only known after merging
+  if (!mergeOptions.fusedVerification && !reportResults())
+    return 1;
+
+  // Keep the files, only without redundant overlaps
+  if (args["--trim-in-place"].asBool())
+  {
+    std::cout << "\nOverlaps with a quota of at least " << minimumQuota
+              << "% will be removed from the input files.\n";
+
+    char decision = 'y';
+    if (!args["--yes"].asBool())
+    {
+      std::cout << "Trim files in place (y/n)? ";
+      std::cin >> decision;
+    }
+
+    if (decision != 'y' && decision != 'Y')
+      return 0;
+
+    return trimInPlace(fileNames, searchResults, seamOptions.minimumQuota,
+                       args["--trim-heads"].asBool()) ? 0 : 1;
+  }
+
+  std::cout << "\nMatching files will be merged accordingly (regardless of quota),\n"
+            << "while non-matching files will simply be concatenated.\n";
+
+  // Merge files if requested
+  char decision = 'y';
+  if (!args["--yes"].asBool())
+  {
+    std::cout << "Merge files (y/n)? ";
+    std::cin >> decision;
+  }
+
+  if (decision != 'y' && decision != 'Y')
+    return 0;
+
+  if (!mergeFiles(inputs, searchResults, outputFileNames, sinks, mergeOptions))
+    return 1;
+
+  if (mergeOptions.fusedVerification && !reportResults())
+    return 1;
+
+  if (args["--verify"].asBool() && !verifyOutputs(searchResults))
+    return 1;
 
   return 0;
 }
@@ -0,0 +1,158 @@
+#ifndef BINMERGE_H
+#define BINMERGE_H
+
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <string>
+#include <vector>
+
+/******************************************************************************/
+
+struct MatchResult
+{
+  // Results of the pattern search
+  bool patternFound = false;
+  std::size_t matchPosition = 0; // position of the first byte of the match
+  std::size_t patternSize = 0;
+  unsigned bitShift = 0;         // bit-granular search: the match starts this many bits behind matchPosition
+
+  // Results of the byte-wise comparison of the overlapping area
+  std::size_t bytesDiffering = 0;
+
+  // Some useful methods
+  std::size_t overlapCount() const
+  {
+    return matchPosition + patternSize;
+  }
+
+  double quota() const
+  {
+    if (!patternFound || overlapCount() == 0)
+      return 0.0;
+    else
+      return static_cast<double>(overlapCount()-bytesDiffering) / overlapCount();
+  }
+};
+
+// Plain text (de)serialization, e.g. for exchanging results between processes
+std::ostream& operator<<(std::ostream& stream, const MatchResult& result);
+std::istream& operator>>(std::istream& stream, MatchResult& result);
+
+/******************************************************************************/
+
+// Input files and the analysis result of each seam, see savePlan()
+struct MergePlan
+{
+  std::vector<std::string> fileNames;
+  std::vector<std::uint64_t> fileSizes;
+  std::vector<std::int64_t> modificationTimes;
+  std::vector<MatchResult> searchResults;
+};
+
+bool savePlan(const std::string& planFileName, const MergePlan& plan);
+bool loadPlan(const std::string& planFileName, MergePlan& plan);
+
+// Contiguous range of an input file and its position in the output
+struct Extent
+{
+  std::size_t file;
+  std::uint64_t sourceOffset;
+  std::uint64_t outputOffset;
+  std::uint64_t length;
+};
+
+std::vector<Extent> planExtents(const std::vector<std::uint64_t>& fileSizes,
+                                const std::vector<MatchResult>& searchResults);
+
+/******************************************************************************/
+
+// Finds the first occurrence of the pattern at or behind pos. With a stride
+// greater than 1, only positions p with p % stride == phase are considered.
+// Matches starting length bytes or more behind pos are not searched for.
+MatchResult searchInFile(std::istream& file, std::vector<unsigned char>& pattern, std::streampos pos = 0,
+                         std::size_t stride = 1, std::size_t phase = 0,
+                         std::uint64_t length = UINT64_MAX);
+
+// Like searchInFile(), but the pattern may start at any bit (most significant
+// first), searching all 8 bit offsets at once. The search starts bitPosition
+// bits into the file.
+MatchResult searchBitsInFile(std::istream& file, const std::vector<unsigned char>& pattern,
+                             std::uint64_t bitPosition = 0);
+
+// Counts the differing bytes of both streams from their current positions
+// on; with a shift, the bytes of file2 are taken from that many bits later
+std::size_t compareFiles(std::istream& file1, std::istream& file2, unsigned shift = 0);
+
+struct SeamOptions
+{
+  bool best = false;         // continue searching for a better match
+  bool compare = true;       // compare the overlapping area byte-wise
+  double minimumQuota = 0.7; // quota that is considered a good match
+  bool verbose = true;       // print details
+  std::size_t patternSize = 20;  // length of the tail searched for
+  bool transportStream = false;  // only search at the packet grid if possible
+  bool bitGranular = false;      // the overlap may start at any bit, see searchBitsInFile()
+  std::size_t candidates = 1;    // with best: search on until this many good matches were found
+};
+
+// Searches the tail of file1 in file2 and compares the overlaps found. The
+// best match is returned; if candidates is given, it receives up to
+// options.candidates compared matches, best quota first.
+MatchResult analyzeSeam(std::istream& file1, std::istream& file2,
+                        const std::string& fileName2, const SeamOptions& options,
+                        std::vector<MatchResult>* candidates = nullptr);
+
+std::string getFilename(const std::string& path);
+
+class InputFiles;
+
+// Receives the merged data while mergeFiles() writes it
+class MergeSink
+{
+public:
+  virtual ~MergeSink() = default;
+
+  // Called before any data is passed on
+  virtual void beginMerge(const InputFiles&, const std::vector<MatchResult>&) {}
+
+  // Called with the index of an input file and the output offset it starts
+  // at, before its data is passed on
+  virtual void beginFile(std::size_t, std::uint64_t) {}
+
+  virtual void write(const unsigned char* data, std::size_t size) = 0;
+
+  // Called once all data has been written, returns false (after reporting
+  // why) if the sink failed
+  virtual bool finish() { return true; }
+};
+
+struct MergeOptions
+{
+  // Compare each overlap while copying it (the analysis only searched for the
+  // pattern); seams whose quota is below the minimum are concatenated instead
+  bool fusedVerification = false;
+  double minimumQuota = 0.7;
+
+  // Write the output as parts of at most this many bytes (0 = single file),
+  // cut at transport stream packet boundaries if packetAligned is set
+  std::uint64_t splitSize = 0;
+  bool packetAligned = false;
+
+  // Compress the output in the seekable zstd format with this level (0 =
+  // uncompressed), using the given number of threads
+  int compressionLevel = 0;
+  unsigned threads = 1;
+
+  // Bound on simultaneously open input files (see InputFiles)
+  std::size_t maxOpen = 64;
+};
+
+// Returns false (after reporting why) if an input or output file fails
+bool mergeFiles(InputFiles& inputs,
+                std::vector<MatchResult>& searchResults,
+                const std::vector<std::string>& outputFileNames,
+                const std::vector<MergeSink*>& sinks = {},
+                const MergeOptions& options = MergeOptions());
+
+#endif // BINMERGE_H
@@ -0,0 +1,254 @@
+#include "cluster.h"
+
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <numeric>
+#include <thread>
+#include <unordered_map>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "gear.h"
+#include "inputs.h"
+#include "verify.h"
+
+/******************************************************************************/
+
+namespace
+{
+  constexpr int anchorShift = 58;            // one anchor per 64 bytes on average
+  constexpr std::size_t tailAnchors = 16;    // fingerprint of a file's end
+  constexpr std::uint64_t tailSize = 1 << 20;
+  constexpr std::size_t commonAnchor = 4;    // in more tails than this, it is no fingerprint (e.g. stuffing)
+  constexpr std::size_t blockSize = 1 << 20;
+
+  // Calls function(i) for i in [0, count) on the given number of threads
+  template <typename Function>
+  void forEachParallel(std::size_t count, unsigned threads, Function function)
+  {
+    std::atomic<std::size_t> next(0);
+
+    auto worker = [&]
+    {
+      for (std::size_t i; (i = next++) < count;)
+        function(i);
+    };
+
+    std::vector<std::thread> workers;
+    for (unsigned t = 1; t < threads && t < count; ++t)
+      workers.emplace_back(worker);
+
+    worker();
+
+    for (auto& thread : workers)
+      thread.join();
+  }
+
+  // Calls found(hash) for every anchor within the range of the file
+  template <typename Found>
+  bool scanAnchors(const std::string& fileName, std::uint64_t offset, std::uint64_t length, Found found)
+  {
+    int file = open(fileName.c_str(), O_RDONLY | O_CLOEXEC);
+    if (file < 0)
+      return false;
+
+    posix_fadvise(file, offset, length, POSIX_FADV_SEQUENTIAL);
+
+    std::unique_ptr<unsigned char[]> buffer(new unsigned char[blockSize]);
+    std::uint64_t hash = 0, position = 0;
+
+    while (position < length)
+    {
+      ssize_t bytesRead = pread(file, &buffer[0], std::min<std::uint64_t>(blockSize, length - position),
+                                offset + position);
+      if (bytesRead <= 0)
+        break;
+
+      for (ssize_t k = 0; k < bytesRead; ++k)
+      {
+        hash = gearUpdate(hash, buffer[k]);
+        if (++position >= gearWindow && (hash >> anchorShift) == 0)
+          found(hash);
+      }
+    }
+
+    close(file);
+    return position == length;
+  }
+
+  struct Candidate
+  {
+    std::size_t predecessor, successor;
+    std::size_t votes;
+    MatchResult result;
+    bool confirmed = false;
+  };
+
+  std::size_t findRoot(std::vector<std::size_t>& parents, std::size_t i)
+  {
+    while (parents[i] != i)
+      i = parents[i] = parents[parents[i]];
+    return i;
+  }
+}
+
+/******************************************************************************/
+
+std::vector<Chain> clusterFiles(const std::vector<std::string>& fileNames, const ClusterOptions& options)
+{
+  const std::size_t count = fileNames.size();
+
+  std::vector<std::uint64_t> sizes(count, 0);
+  for (std::size_t i = 0; i < count; ++i)
+  {
+    struct stat info;
+    if (stat(fileNames[i].c_str(), &info) == 0)
+      sizes[i] = info.st_size;
+  }
+
+  // The last anchors of every file
+  std::vector<std::vector<std::uint64_t>> tails(count);
+
+  forEachParallel(count, options.threads, [&](std::size_t i)
+  {
+    std::uint64_t length = std::min(tailSize, sizes[i]);
+    std::vector<std::uint64_t> anchors;
+
+    scanAnchors(fileNames[i], sizes[i] - length, length, [&](std::uint64_t hash) { anchors.push_back(hash); });
+
+    std::size_t keep = std::min(tailAnchors, anchors.size());
+    tails[i].assign(anchors.end() - keep, anchors.end());
+  });
+
+  std::unordered_map<std::uint64_t, std::vector<std::size_t>> owners;
+  for (std::size_t i = 0; i < count; ++i)
+  {
+    for (auto hash : tails[i])
+    {
+      auto& files = owners[hash];
+      if (files.empty() || files.back() != i)
+        files.push_back(i);
+    }
+  }
+
+  for (auto it = owners.begin(); it != owners.end();)
+    it = it->second.size() > commonAnchor ? owners.erase(it) : std::next(it);
+
+  // Every head in which the end of another file shows up proposes a seam
+  std::vector<std::vector<Candidate>> proposals(count);
+
+  forEachParallel(count, options.threads, [&](std::size_t j)
+  {
+    std::map<std::size_t, std::size_t> votes;
+
+    scanAnchors(fileNames[j], 0, std::min(options.maximumOverlap, sizes[j]), [&](std::uint64_t hash)
+    {
+      auto owner = owners.find(hash);
+      if (owner != owners.end())
+        for (auto i : owner->second)
+          if (i != j)
+            ++votes[i];
+    });
+
+    for (const auto& vote : votes)
+      proposals[j].push_back(Candidate{vote.first, j, vote.second, MatchResult()});
+  });
+
+  std::vector<Candidate> candidates;
+  for (auto& proposal : proposals)
+    candidates.insert(candidates.end(), proposal.begin(), proposal.end());
+
+  // Confirmed just like any seam
+  SeamOptions seamOptions = options.seamOptions;
+  seamOptions.verbose = false;
+
+  forEachParallel(candidates.size(), options.threads, [&](std::size_t k)
+  {
+    Candidate& candidate = candidates[k];
+    std::ifstream file1(fileNames[candidate.predecessor], std::ios::binary);
+    std::ifstream file2(fileNames[candidate.successor], std::ios::binary);
+    if (!file1 || !file2)
+      return;
+
+    candidate.result = analyzeSeam(file1, file2, fileNames[candidate.successor], seamOptions);
+    candidate.confirmed = candidate.result.patternFound &&
+                          candidate.result.overlapCount() <= sizes[candidate.predecessor] &&
+                          (!seamOptions.compare || candidate.result.quota() >= seamOptions.minimumQuota);
+  });
+
+  // Best supported seams first; a union-find over the chains rules out cycles
+  std::stable_sort(candidates.begin(), candidates.end(), [](const Candidate& a, const Candidate& b)
+  {
+    return a.votes > b.votes;
+  });
+
+  const std::size_t none = count;
+  std::vector<std::size_t> predecessors(count, none), successors(count, none), parents(count);
+  std::vector<MatchResult> results(count);
+  std::iota(parents.begin(), parents.end(), 0);
+
+  for (const auto& candidate : candidates)
+  {
+    std::size_t i = candidate.predecessor, j = candidate.successor;
+    if (!candidate.confirmed || successors[i] != none || predecessors[j] != none ||
+        findRoot(parents, i) == findRoot(parents, j))
+      continue;
+
+    successors[i] = j;
+    predecessors[j] = i;
+    results[i] = candidate.result;
+    parents[findRoot(parents, i)] = findRoot(parents, j);
+  }
+
+  // Chains in the order of their first files
+  std::vector<Chain> chains;
+  for (std::size_t i = 0; i < count; ++i)
+  {
+    if (predecessors[i] != none)
+      continue;
+
+    Chain chain;
+    for (std::size_t k = i; k != none; k = successors[k])
+    {
+      chain.fileNames.push_back(fileNames[k]);
+      if (successors[k] != none)
+        chain.searchResults.push_back(results[k]);
+    }
+
+    chains.push_back(std::move(chain));
+  }
+
+  return chains;
+}
+
+/******************************************************************************/
+
+bool mergeChains(const std::vector<Chain>& chains, const std::vector<std::string>& outputFileNames,
+                 const MergeOptions& options, bool verify)
+{
+  // Whole chains are distributed among the threads, the rest of them helps
+  // within each chain
+  unsigned workers = std::max<unsigned>(1, std::min<std::size_t>(options.threads, chains.size()));
+  MergeOptions chainOptions = options;
+  chainOptions.threads = std::max(1u, options.threads / workers);
+
+  std::atomic<bool> failed(false);
+
+  forEachParallel(chains.size(), workers, [&](std::size_t i)
+  {
+    InputFiles inputs(chains[i].fileNames);
+    std::vector<MatchResult> searchResults = chains[i].searchResults;
+
+    if (!mergeFiles(inputs, searchResults, {outputFileNames[i]}, {}, chainOptions) ||
+        (verify && !verifyOutput(inputs.names(), planExtents(inputs.sizes(), searchResults),
+                                 outputFileNames[i], chainOptions.threads)))
+      failed = true;
+  });
+
+  return !failed;
+}
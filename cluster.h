@@ -0,0 +1,42 @@
+#ifndef CLUSTER_H
+#define CLUSTER_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "binmerge.h"
+
+/******************************************************************************/
+
+// Segments of one recording in order, with the seams between them
+struct Chain
+{
+  std::vector<std::string> fileNames;
+  std::vector<MatchResult> searchResults;
+};
+
+struct ClusterOptions
+{
+  SeamOptions seamOptions;
+  // Longest overlap that is found, every file's head is scanned this far
+  std::uint64_t maximumOverlap = 16 << 20;
+  unsigned threads = 1;
+};
+
+// Sorts files of unrelated recordings into chains of overlapping segments.
+// Every file is fingerprinted by the content-defined anchors (see gear.h)
+// right in front of its end; scanning the heads of all files for these
+// anchors proposes successors, which are confirmed with analyzeSeam(). Each
+// file gets at most one predecessor and one successor, the best supported
+// candidates first. Files overlapping with no other file form chains of
+// their own. Work is shared by the given number of threads.
+std::vector<Chain> clusterFiles(const std::vector<std::string>& fileNames, const ClusterOptions& options);
+
+// Merges every chain into its own output. The chains are distributed among
+// the threads of the merge options; with --verify, each output is checked
+// right after merging it. Returns false if any chain failed.
+bool mergeChains(const std::vector<Chain>& chains, const std::vector<std::string>& outputFileNames,
+                 const MergeOptions& options, bool verify);
+
+#endif // CLUSTER_H
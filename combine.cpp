@@ -0,0 +1,442 @@
+#include "combine.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <thread>
+
+#include "kernels.h"
+#include "output.h"
+
+/******************************************************************************/
+
+namespace
+{
+  constexpr std::size_t chunkSize = 1 << 20; // read from every recording at once
+  constexpr std::size_t blockSize = 4 << 10; // unit of the vote
+
+  enum class State
+  {
+    Active,   // in step with the output
+    Waiting,  // lost data, continues at joinAt
+    Dropped,  // lost for good
+    Finished  // all data used
+  };
+
+  struct Recording
+  {
+    std::istream* file = nullptr;
+    std::uint64_t size = 0;
+    State state = State::Active;
+    std::uint64_t position = 0; // next byte to be read
+    std::uint64_t joinAt = 0;   // output offset at which a waiting recording continues
+
+    // Statistics, the number of outvoted bytes also ranks the recordings
+    std::uint64_t errors = 0;
+    std::uint64_t gaps = 0;
+
+    std::unique_ptr<unsigned char[]> chunk{new unsigned char[chunkSize]};
+    std::size_t chunkLength = 0;
+  };
+
+  std::size_t readAt(std::istream& file, std::uint64_t position, unsigned char* buffer, std::size_t length)
+  {
+    file.clear();
+    file.seekg(position);
+    file.read(reinterpret_cast<char*>(buffer), length);
+    return file.gcount();
+  }
+
+  // Takes every byte of the block by majority of the recordings that cover
+  // it. The voters are ordered by reliability, so the first one wins ties.
+  void vote(const std::vector<Recording>& recordings, const std::vector<std::size_t>& voters,
+            std::size_t offset, std::size_t length, unsigned char* block)
+  {
+    auto covers = [&](std::size_t i, std::size_t j)
+    {
+      return recordings[i].chunkLength > offset + j;
+    };
+
+    // Usually all agree
+    bool unanimous = true;
+    for (auto i : voters)
+      unanimous = unanimous && covers(i, length - 1) &&
+                  std::memcmp(&recordings[i].chunk[offset], &recordings[voters[0]].chunk[offset], length) == 0;
+
+    if (unanimous)
+    {
+      std::memcpy(block, &recordings[voters[0]].chunk[offset], length);
+      return;
+    }
+
+    for (std::size_t j = 0; j < length; ++j)
+    {
+      std::size_t bestVotes = 0;
+
+      for (auto a : voters)
+      {
+        if (!covers(a, j))
+          continue;
+
+        unsigned char value = recordings[a].chunk[offset + j];
+        std::size_t votes = 0;
+
+        for (auto b : voters)
+          votes += covers(b, j) && recordings[b].chunk[offset + j] == value;
+
+        if (votes > bestVotes)
+        {
+          bestVotes = votes;
+          block[j] = value;
+        }
+
+        // Nobody can beat an absolute majority
+        if (2 * bestVotes > voters.size())
+          break;
+      }
+    }
+  }
+
+  std::vector<unsigned char> readPattern(std::istream& file, std::uint64_t position, std::size_t size)
+  {
+    std::vector<unsigned char> pattern(size);
+    pattern.resize(readAt(file, position, pattern.data(), size));
+    return pattern;
+  }
+}
+
+/******************************************************************************/
+
+bool alignRecordings(InputFiles& inputs, const CombineOptions& options,
+                     std::vector<std::uint64_t>& starts)
+{
+  // Relative to the start of the first recording, which may be late itself
+  std::vector<std::int64_t> offsets(inputs.size(), 0);
+
+  for (std::size_t i = 0; i < inputs.size(); ++i)
+  {
+    if (inputs.fileSize(i) < options.patternSize)
+    {
+      std::cerr << "File: " << inputs.name(i) << " is too short." << '\n';
+      return false;
+    }
+  }
+
+  for (std::size_t i = 1; i < inputs.size(); ++i)
+  {
+    std::istream& first = inputs.open(0);
+    std::istream& file = inputs.open(i);
+
+    if (!first || !file)
+    {
+      std::cerr << "File: " << inputs.name(file ? 0 : i) << " failed to open." << '\n';
+      return false;
+    }
+
+    // Started later than the first recording, or earlier
+    std::vector<unsigned char> pattern = readPattern(file, 0, options.patternSize);
+    MatchResult result = searchInFile(first, pattern, 0, 1, 0, options.maximumGap);
+
+    if (result.patternFound)
+      offsets[i] = result.matchPosition;
+    else
+    {
+      pattern = readPattern(first, 0, options.patternSize);
+      result = searchInFile(file, pattern, 0, 1, 0, options.maximumGap);
+
+      if (!result.patternFound)
+      {
+        std::cerr << "File: " << inputs.name(i) << " does not overlap with "
+                  << inputs.name(0) << '\n';
+        return false;
+      }
+
+      offsets[i] = -static_cast<std::int64_t>(result.matchPosition);
+    }
+  }
+
+  std::int64_t earliest = *std::min_element(offsets.begin(), offsets.end());
+
+  starts.clear();
+  for (auto offset : offsets)
+    starts.push_back(offset - earliest);
+
+  return true;
+}
+
+/******************************************************************************/
+
+bool combineRecordings(InputFiles& inputs, const std::vector<std::uint64_t>& starts,
+                       const std::vector<std::string>& outputFileNames,
+                       const std::vector<MergeSink*>& sinks,
+                       const CombineOptions& options, const MergeOptions& mergeOptions)
+{
+  std::vector<std::unique_ptr<MergeSink>> outputs;
+  for (const auto& outputFileName : outputFileNames)
+  {
+    std::unique_ptr<MergeSink> output = openOutput(outputFileName, mergeOptions);
+    if (!output)
+      return false;
+
+    if (outputFileNames.size() > 1)
+      output.reset(new AsyncSink(std::move(output)));
+    outputs.push_back(std::move(output));
+  }
+
+  // All recordings are read in turns, so their streams stay open throughout
+  std::vector<Recording> recordings(inputs.size());
+  for (std::size_t i = 0; i < recordings.size(); ++i)
+  {
+    Recording& recording = recordings[i];
+    recording.file = &inputs.open(i);
+    recording.size = inputs.fileSize(i);
+    recording.joinAt = starts[i];
+    recording.state = starts[i] > 0 ? State::Waiting : State::Active;
+
+    if (!*recording.file)
+    {
+      std::cerr << "File: " << inputs.name(i) << " failed to open." << '\n';
+      return false;
+    }
+  }
+
+  std::unique_ptr<unsigned char[]> combined(new unsigned char[chunkSize]);
+  std::uint64_t outputOffset = 0;
+
+  // Sets aside a recording that went astray in the current block, if its
+  // tail shows up within the reference's data ahead
+  auto resynchronize = [&](Recording& lost, const Recording& reference,
+                           std::size_t blockStart, std::size_t lostLength)
+  {
+    if (lostLength < options.patternSize)
+      return false;
+
+    std::vector<unsigned char> pattern(&lost.chunk[blockStart + lostLength - options.patternSize],
+                                       &lost.chunk[blockStart + lostLength]);
+    std::uint64_t referenceStart = reference.position + blockStart;
+
+    MatchResult result = searchInFile(*reference.file, pattern, referenceStart, 1, 0,
+                                      options.maximumGap + blockSize);
+    if (!result.patternFound)
+      return false;
+
+    lost.state = State::Waiting;
+    lost.position += blockStart + lostLength - options.patternSize;
+    lost.joinAt = outputOffset + blockStart + (result.matchPosition - referenceStart);
+    ++lost.gaps;
+
+    if (options.verbose)
+      std::cout << "File: " << inputs.name(&lost - &recordings[0]) << " lost step at output offset "
+                << outputOffset + blockStart << " and continues at " << lost.joinAt << '\n';
+
+    return true;
+  };
+
+  for (;;)
+  {
+    // Waiting recordings continue where the output has arrived; if nothing
+    // else is left, the output cannot do without a gap of its own
+    bool anyActive = std::any_of(recordings.begin(), recordings.end(),
+                                 [](const Recording& r) { return r.state == State::Active; });
+    std::uint64_t nextJoin = UINT64_MAX;
+
+    for (const auto& recording : recordings)
+      if (recording.state == State::Waiting)
+        nextJoin = std::min(nextJoin, recording.joinAt);
+
+    if (!anyActive && nextJoin == UINT64_MAX)
+      break;
+
+    if (!anyActive && nextJoin > outputOffset)
+    {
+      std::cerr << "None of the files covers " << nextJoin - outputOffset
+                << " bytes at output offset " << outputOffset << '\n';
+
+      for (auto& recording : recordings)
+        if (recording.state == State::Waiting && recording.joinAt == nextJoin)
+          recording.joinAt = outputOffset;
+    }
+
+    for (auto& recording : recordings)
+    {
+      if (recording.state == State::Waiting && recording.joinAt <= outputOffset)
+      {
+        recording.position += outputOffset - recording.joinAt;
+        recording.state = recording.position < recording.size ? State::Active : State::Finished;
+      }
+    }
+
+    // The chunk ends where the next recording joins
+    std::size_t length = chunkSize;
+    std::vector<std::size_t> active;
+
+    for (std::size_t i = 0; i < recordings.size(); ++i)
+    {
+      if (recordings[i].state == State::Active)
+        active.push_back(i);
+      else if (recordings[i].state == State::Waiting)
+        length = std::min<std::uint64_t>(length, recordings[i].joinAt - outputOffset);
+    }
+
+    if (active.empty())
+      continue;
+
+    // Every recording is read on a thread of its own, they may well be on
+    // different devices
+    auto read = [&](std::size_t i)
+    {
+      Recording& recording = recordings[i];
+      std::size_t requested = std::min<std::uint64_t>(length, recording.size - recording.position);
+      recording.chunkLength = readAt(*recording.file, recording.position, &recording.chunk[0], requested);
+      return recording.chunkLength == requested;
+    };
+
+    std::vector<std::thread> readers;
+    std::unique_ptr<bool[]> complete(new bool[active.size()]);
+
+    for (std::size_t k = 1; k < active.size(); ++k)
+      readers.emplace_back([&, k] { complete[k] = read(active[k]); });
+
+    complete[0] = read(active[0]);
+    for (auto& reader : readers)
+      reader.join();
+
+    for (std::size_t k = 0; k < active.size(); ++k)
+    {
+      if (!complete[k])
+      {
+        std::cerr << "File: " << inputs.name(active[k]) << " could not be read." << '\n';
+        return false;
+      }
+    }
+
+    // Vote block by block, until the set of recordings changes
+    std::size_t consumed = 0;
+    bool changed = false;
+
+    while (!changed)
+    {
+      std::vector<std::size_t> voters;
+      for (auto i : active)
+        if (recordings[i].state == State::Active && recordings[i].chunkLength > consumed)
+          voters.push_back(i);
+
+      if (voters.empty())
+        break;
+
+      // The most reliable recording comes first and wins ties
+      std::stable_sort(voters.begin(), voters.end(), [&](std::size_t a, std::size_t b)
+      {
+        return recordings[a].errors < recordings[b].errors;
+      });
+
+      auto voterLength = [&](std::size_t i)
+      {
+        return std::min(blockSize, recordings[i].chunkLength - consumed);
+      };
+
+      while (!voters.empty())
+      {
+        std::size_t blockLength = 0;
+        for (auto i : voters)
+          blockLength = std::max(blockLength, voterLength(i));
+
+        unsigned char* block = &combined[consumed];
+        vote(recordings, voters, consumed, blockLength, block);
+
+        // Bit errors leave a few differences, a recording that lost data
+        // differs almost everywhere
+        std::vector<std::size_t> differences, lost;
+
+        for (auto i : voters)
+        {
+          differences.push_back(countDifferences(&recordings[i].chunk[consumed], block, voterLength(i)));
+
+          if (voters.size() > 1 && voterLength(i) >= options.patternSize &&
+              differences.back() > voterLength(i) / 4)
+            lost.push_back(i);
+        }
+
+        if (lost.empty())
+        {
+          for (std::size_t k = 0; k < voters.size(); ++k)
+            recordings[voters[k]].errors += differences[k];
+
+          consumed += blockLength;
+          break;
+        }
+
+        // Set the lost ones aside and vote again, which ends the chunk. Of
+        // two recordings, the outvoted one is not necessarily the one that
+        // lost data.
+        changed = true;
+
+        std::size_t reference = voters[0];
+        for (auto i : voters)
+        {
+          if (std::find(lost.begin(), lost.end(), i) == lost.end())
+          {
+            reference = i;
+            break;
+          }
+        }
+
+        for (auto i : lost)
+        {
+          if (i == reference || resynchronize(recordings[i], recordings[reference], consumed, voterLength(i)))
+            continue;
+
+          if (voters.size() == 2 &&
+              resynchronize(recordings[reference], recordings[i], consumed, voterLength(reference)))
+            continue;
+
+          recordings[i].state = State::Dropped;
+          std::cerr << "File: " << inputs.name(i) << " could not be aligned again at output offset "
+                    << outputOffset + consumed << " and is left out from there on." << '\n';
+        }
+
+        voters.erase(std::remove_if(voters.begin(), voters.end(), [&](std::size_t i)
+        {
+          return recordings[i].state != State::Active;
+        }), voters.end());
+      }
+    }
+
+    for (auto& output : outputs)
+      output->write(&combined[0], consumed);
+    for (auto sink : sinks)
+      sink->write(&combined[0], consumed);
+
+    // Those set aside already point to where they continue
+    for (auto i : active)
+    {
+      Recording& recording = recordings[i];
+      if (recording.state != State::Active)
+        continue;
+
+      recording.position += std::min(consumed, recording.chunkLength);
+      if (recording.position >= recording.size)
+        recording.state = State::Finished;
+    }
+
+    outputOffset += consumed;
+  }
+
+  bool written = true;
+  for (auto& output : outputs)
+    written = output->finish() && written;
+  // Checksum files and indexes must not vouch for an output that failed
+  for (auto sink : sinks)
+    written = written && sink->finish();
+
+  std::cout << "Combined " << outputOffset << " bytes\n";
+  for (std::size_t i = 0; i < recordings.size(); ++i)
+  {
+    std::cout << "File: " << inputs.name(i) << ": " << recordings[i].gaps << " gap(s), "
+              << recordings[i].errors << " byte(s) outvoted"
+              << (recordings[i].state == State::Dropped ? ", left out in the end" : "") << '\n';
+  }
+
+  return written;
+}
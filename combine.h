@@ -0,0 +1,41 @@
+#ifndef COMBINE_H
+#define COMBINE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "binmerge.h"
+#include "inputs.h"
+
+/******************************************************************************/
+
+struct CombineOptions
+{
+  // Length of the patterns by which the recordings are aligned
+  std::size_t patternSize = 20;
+  // Longest gap in a recording (and difference between the starts of two
+  // recordings) that can be bridged, bounds each search
+  std::uint64_t maximumGap = 64 << 20;
+  bool verbose = true;
+};
+
+// Finds where each recording starts in the combined output, by searching the
+// head of each recording in the first one and vice versa. Returns false if a
+// recording does not overlap with the first one.
+bool alignRecordings(InputFiles& inputs, const CombineOptions& options,
+                     std::vector<std::uint64_t>& starts);
+
+// Combines simultaneous recordings of the same stream, each with gaps and bit
+// errors of its own, into one output in a single pass over all of them. The
+// recordings are read on one thread each and every output byte is taken by
+// majority; bytes without one come from the recording with the fewest errors
+// so far. A recording that stops agreeing with the others has lost data: it
+// is set aside until the output reaches the point at which it continues
+// (found with searchInFile()). Returns false on error.
+bool combineRecordings(InputFiles& inputs, const std::vector<std::uint64_t>& starts,
+                       const std::vector<std::string>& outputFileNames,
+                       const std::vector<MergeSink*>& sinks,
+                       const CombineOptions& options, const MergeOptions& mergeOptions);
+
+#endif // COMBINE_H
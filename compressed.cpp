@@ -0,0 +1,412 @@
+#include "compressed.h"
+
+#include <algorithm>
+#include <climits>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#ifdef BINMERGE_HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#ifdef BINMERGE_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+/******************************************************************************/
+
+namespace
+{
+  constexpr std::size_t bufferSize = 256 << 10;
+
+  bool endsWith(const std::string& text, const std::string& suffix)
+  {
+    return text.size() >= suffix.size() &&
+           text.compare(text.size() - suffix.size(), suffix.size(), suffix) == 0;
+  }
+
+  // Seekable stream buffer on top of a decoder that can only go forward, but
+  // may be moved back to certain positions (frames) of the stream
+  class DecompressingBuffer : public DecompressedBuffer
+  {
+  public:
+    explicit DecompressingBuffer(std::uint64_t size)
+      : size(size), buffer(bufferSize)
+    {
+      setg(buffer.data(), buffer.data(), buffer.data());
+    }
+
+  protected:
+    // Decompresses up to length bytes at the position of the decoder,
+    // returns 0 at the end of the data or on errors (setting failed)
+    virtual std::size_t decompress(char* data, std::size_t length) = 0;
+
+    // Moves the decoder to a position at or in front of target (possibly
+    // leaving it at current) and returns that position
+    virtual std::uint64_t reposition(std::uint64_t target, std::uint64_t current) = 0;
+
+    int_type underflow() override
+    {
+      if (gptr() < egptr())
+        return traits_type::to_int_type(*gptr());
+
+      bufferOffset += egptr() - eback();
+      std::size_t length = failed ? 0 : decompress(buffer.data(), buffer.size());
+      setg(buffer.data(), buffer.data(), buffer.data() + length);
+
+      return length > 0 ? traits_type::to_int_type(*gptr()) : traits_type::eof();
+    }
+
+    pos_type seekoff(off_type offset, std::ios_base::seekdir direction,
+                     std::ios_base::openmode) override
+    {
+      std::uint64_t current = bufferOffset + (gptr() - eback());
+      std::uint64_t base = direction == std::ios_base::beg ? 0 :
+                           direction == std::ios_base::cur ? current : size;
+
+      if (offset < 0 && static_cast<std::uint64_t>(-offset) > base)
+        return pos_type(off_type(-1));
+
+      return seekTo(base + offset);
+    }
+
+    pos_type seekpos(pos_type position, std::ios_base::openmode mode) override
+    {
+      return seekoff(off_type(position), std::ios_base::beg, mode);
+    }
+
+  private:
+    pos_type seekTo(std::uint64_t target)
+    {
+      std::uint64_t decoded = bufferOffset + (egptr() - eback());
+
+      // Still in the buffer
+      if (target >= bufferOffset && target <= decoded)
+      {
+        setg(eback(), eback() + (target - bufferOffset), egptr());
+        return pos_type(off_type(target));
+      }
+
+      // Otherwise decompress from the best starting point up to the target
+      std::uint64_t position = reposition(target, decoded);
+
+      while (position < target)
+      {
+        std::size_t length = decompress(buffer.data(), std::min<std::uint64_t>(buffer.size(), target - position));
+        if (length == 0)
+          break;
+        position += length;
+      }
+
+      // Like a file cut short, corrupt data can be seeked past to read nothing
+      bufferOffset = failed ? target : position;
+      setg(buffer.data(), buffer.data(), buffer.data());
+
+      return position == target || failed ? pos_type(off_type(target)) : pos_type(off_type(-1));
+    }
+
+    std::uint64_t size;
+    std::vector<char> buffer;
+    std::uint64_t bufferOffset = 0; // stream position of the start of the buffer
+  };
+
+/******************************************************************************/
+
+#ifdef BINMERGE_HAVE_ZLIB
+  // gzip files (including concatenated members) through zlib. A deflate
+  // stream has no points to start decompressing from other than its
+  // beginning, so seeking backwards starts over.
+  class GzipBuffer : public DecompressingBuffer
+  {
+  public:
+    GzipBuffer(const std::string& fileName, std::uint64_t size)
+      : DecompressingBuffer(size), file(gzopen(fileName.c_str(), "rb"))
+    {
+      if (file)
+        gzbuffer(file, bufferSize);
+    }
+
+    ~GzipBuffer()
+    {
+      if (file)
+        gzclose(file);
+    }
+
+    bool isOpen() const { return file != nullptr; }
+
+  protected:
+    std::size_t decompress(char* data, std::size_t length) override
+    {
+      int bytesRead = gzread(file, data, static_cast<unsigned>(std::min<std::size_t>(length, INT_MAX)));
+      if (bytesRead > 0)
+        return bytesRead;
+
+      // Truncated or damaged data, rather than the end of the last member
+      int error;
+      gzerror(file, &error);
+      failed = bytesRead < 0 || error != Z_OK;
+      return 0;
+    }
+
+    std::uint64_t reposition(std::uint64_t target, std::uint64_t current) override
+    {
+      if (target >= current)
+        return current;
+
+      gzrewind(file);
+      return 0;
+    }
+
+  private:
+    gzFile file;
+  };
+#endif
+
+/******************************************************************************/
+
+#ifdef BINMERGE_HAVE_ZSTD
+  // Start of a zstd frame in the compressed and the decompressed data
+  struct ZstdFrame
+  {
+    std::uint64_t compressedOffset;
+    std::uint64_t decompressedOffset;
+  };
+
+  std::uint32_t readLittleEndian32(const unsigned char* data)
+  {
+    return data[0] | data[1] << 8 | data[2] << 16 | std::uint32_t(data[3]) << 24;
+  }
+
+  // Reads the seek table of the seekable zstd format, a skippable frame at
+  // the end of the file listing the compressed and decompressed size of every
+  // frame. Returns false if there is none.
+  bool readSeekTable(int fd, std::vector<ZstdFrame>& frames, std::uint64_t& decompressedSize)
+  {
+    constexpr std::uint32_t skippableMagic = 0x184D2A5E;
+    constexpr std::uint32_t seekableMagic = 0x8F92EAB1;
+    constexpr std::size_t footerSize = 9;
+
+    off_t fileSize = lseek(fd, 0, SEEK_END);
+    unsigned char footer[footerSize];
+
+    if (fileSize < off_t(footerSize + 8) ||
+        pread(fd, footer, footerSize, fileSize - footerSize) != static_cast<ssize_t>(footerSize) ||
+        readLittleEndian32(&footer[5]) != seekableMagic)
+      return false;
+
+    std::uint64_t frameCount = readLittleEndian32(&footer[0]);
+    std::size_t entrySize = footer[4] & 0x80 ? 12 : 8;
+    std::uint64_t tableSize = frameCount * entrySize + footerSize;
+
+    if (tableSize + 8 > static_cast<std::uint64_t>(fileSize))
+      return false;
+
+    std::vector<unsigned char> table(tableSize + 8);
+    if (pread(fd, table.data(), table.size(), fileSize - table.size()) != static_cast<ssize_t>(table.size()) ||
+        readLittleEndian32(&table[0]) != skippableMagic || readLittleEndian32(&table[4]) != tableSize)
+      return false;
+
+    frames.clear();
+    std::uint64_t compressedOffset = 0;
+    decompressedSize = 0;
+
+    for (std::uint64_t i = 0; i < frameCount; ++i)
+    {
+      const unsigned char* entry = &table[8 + i * entrySize];
+      frames.push_back(ZstdFrame{compressedOffset, decompressedSize});
+
+      compressedOffset += readLittleEndian32(&entry[0]);
+      decompressedSize += readLittleEndian32(&entry[4]);
+    }
+
+    // The frames have to cover everything in front of the seek table
+    return compressedOffset + table.size() == static_cast<std::uint64_t>(fileSize);
+  }
+
+  // zstd files, seeking to the frame containing the target if a seek table
+  // is present
+  class ZstdBuffer : public DecompressingBuffer
+  {
+  public:
+    ZstdBuffer(const std::string& fileName, std::uint64_t size)
+      : DecompressingBuffer(size),
+        fd(open(fileName.c_str(), O_RDONLY | O_CLOEXEC)),
+        context(ZSTD_createDCtx()),
+        input(ZSTD_DStreamInSize())
+    {
+      std::uint64_t decompressedSize;
+      if (fd < 0 || !readSeekTable(fd, frames, decompressedSize) || frames.empty())
+        frames.assign(1, ZstdFrame{0, 0});
+
+      if (fd >= 0)
+        lseek(fd, 0, SEEK_SET);
+    }
+
+    ~ZstdBuffer()
+    {
+      if (fd >= 0)
+        close(fd);
+      ZSTD_freeDCtx(context);
+    }
+
+    bool isOpen() const { return fd >= 0 && context; }
+
+  protected:
+    std::size_t decompress(char* data, std::size_t length) override
+    {
+      ZSTD_outBuffer out{data, length, 0};
+
+      while (out.pos == 0)
+      {
+        // More input only once the decoder has flushed what it holds
+        if (in.pos == in.size && !draining)
+        {
+          // The file must not end within a frame
+          ssize_t bytesRead = read(fd, input.data(), input.size());
+          if (bytesRead <= 0)
+          {
+            failed = bytesRead < 0 || pending != 0;
+            break;
+          }
+
+          in = ZSTD_inBuffer{input.data(), static_cast<std::size_t>(bytesRead), 0};
+        }
+
+        pending = ZSTD_decompressStream(context, &out, &in);
+        if (ZSTD_isError(pending))
+        {
+          failed = true;
+          break;
+        }
+
+        draining = out.pos == out.size;
+      }
+
+      return out.pos;
+    }
+
+    std::uint64_t reposition(std::uint64_t target, std::uint64_t current) override
+    {
+      auto frame = std::upper_bound(frames.begin(), frames.end(), target,
+                                    [](std::uint64_t offset, const ZstdFrame& f) { return offset < f.decompressedOffset; });
+      --frame;
+
+      // Going on from the current position is cheaper within the same frame
+      if (current >= frame->decompressedOffset && current <= target)
+        return current;
+
+      lseek(fd, frame->compressedOffset, SEEK_SET);
+      in = ZSTD_inBuffer{input.data(), 0, 0};
+      ZSTD_DCtx_reset(context, ZSTD_reset_session_only);
+      pending = 0;
+      draining = false;
+
+      return frame->decompressedOffset;
+    }
+
+  private:
+    int fd;
+    ZSTD_DCtx* context;
+    std::vector<char> input;
+    ZSTD_inBuffer in{nullptr, 0, 0};
+    std::size_t pending = 0; // hint of the decoder, 0 between frames
+    bool draining = false;   // the last call filled the output
+    std::vector<ZstdFrame> frames;
+  };
+#endif
+}
+
+/******************************************************************************/
+
+Compression compressionOf(const std::string& fileName)
+{
+  if (endsWith(fileName, ".gz"))
+    return Compression::gzip;
+  if (endsWith(fileName, ".zst"))
+    return Compression::zstd;
+  return Compression::none;
+}
+
+bool compressionSupported(Compression compression)
+{
+  switch (compression)
+  {
+    case Compression::none:
+      return true;
+    case Compression::gzip:
+#ifdef BINMERGE_HAVE_ZLIB
+      return true;
+#else
+      return false;
+#endif
+    case Compression::zstd:
+#ifdef BINMERGE_HAVE_ZSTD
+      return true;
+#else
+      return false;
+#endif
+  }
+
+  return false;
+}
+
+bool decompressedSize(const std::string& fileName, Compression compression,
+                      std::uint64_t& size, bool& corrupt)
+{
+  corrupt = false;
+
+#ifdef BINMERGE_HAVE_ZSTD
+  if (compression == Compression::zstd)
+  {
+    int fd = open(fileName.c_str(), O_RDONLY | O_CLOEXEC);
+    std::vector<ZstdFrame> frames;
+    bool seekable = fd >= 0 && readSeekTable(fd, frames, size);
+
+    if (fd >= 0)
+      close(fd);
+    if (seekable)
+      return true;
+  }
+#endif
+
+  // Count the bytes the hard way
+  auto buffer = openDecompressed(fileName, compression, 0);
+  if (!buffer)
+    return false;
+
+  std::vector<char> scratch(bufferSize);
+  size = 0;
+
+  for (std::streamsize length; (length = buffer->sgetn(scratch.data(), scratch.size())) > 0;)
+    size += length;
+
+  corrupt = buffer->corrupt();
+  return !corrupt;
+}
+
+std::unique_ptr<DecompressedBuffer> openDecompressed(const std::string& fileName,
+                                                     Compression compression,
+                                                     std::uint64_t size)
+{
+#ifdef BINMERGE_HAVE_ZLIB
+  if (compression == Compression::gzip)
+  {
+    std::unique_ptr<GzipBuffer> buffer(new GzipBuffer(fileName, size));
+    if (buffer->isOpen())
+      return buffer;
+  }
+#endif
+
+#ifdef BINMERGE_HAVE_ZSTD
+  if (compression == Compression::zstd)
+  {
+    std::unique_ptr<ZstdBuffer> buffer(new ZstdBuffer(fileName, size));
+    if (buffer->isOpen())
+      return buffer;
+  }
+#endif
+
+  return nullptr;
+}
@@ -0,0 +1,46 @@
+#ifndef COMPRESSED_H
+#define COMPRESSED_H
+
+#include <cstdint>
+#include <memory>
+#include <streambuf>
+#include <string>
+
+/******************************************************************************/
+
+// Compressed input files, recognized by their extension (".gz", ".zst").
+// Support for each format depends on the libraries found at build time
+// (BINMERGE_HAVE_ZLIB, BINMERGE_HAVE_ZSTD).
+
+enum class Compression { none, gzip, zstd };
+
+Compression compressionOf(const std::string& fileName);
+bool compressionSupported(Compression compression);
+
+// Size of the decompressed data. Files in the seekable zstd format (with a
+// seek table at the end) are not decompressed for this, all others are.
+// Returns false if the file cannot be opened or turns out to be corrupt,
+// which sets corrupt.
+bool decompressedSize(const std::string& fileName, Compression compression,
+                      std::uint64_t& size, bool& corrupt);
+
+// Read-only stream buffer delivering the decompressed data. Seeking forward
+// decompresses up to the new position. Seeking backward starts over from the
+// nearest frame in front of it, which for gzip is the beginning of the file.
+// A decoding error ends the data just like the end of the file, so readers
+// have to check corrupt() before trusting a short read.
+class DecompressedBuffer : public std::streambuf
+{
+public:
+  bool corrupt() const { return failed; }
+
+protected:
+  bool failed = false;
+};
+
+// Returns nullptr if the file cannot be opened
+std::unique_ptr<DecompressedBuffer> openDecompressed(const std::string& fileName,
+                                                     Compression compression,
+                                                     std::uint64_t size);
+
+#endif // COMPRESSED_H
@@ -0,0 +1,97 @@
+#include "consistency.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+/******************************************************************************/
+
+namespace
+{
+  // Cost of an overlap twice (or half) as long as expected, in units of quota
+  constexpr double overlapWeight = 0.05;
+
+  double overlapPenalty(const MatchResult& a, double expected)
+  {
+    return overlapWeight * std::fabs(std::log2((a.overlapCount() + 1.0) / (expected + 1.0)));
+  }
+}
+
+/******************************************************************************/
+
+std::vector<MatchResult> chooseConsistentSeams(const std::vector<std::vector<MatchResult>>& candidates)
+{
+  const std::size_t seams = candidates.size();
+
+  // Prediction: the typical overlap of the best matches
+  std::vector<double> overlaps;
+  for (const auto& seam : candidates)
+    if (!seam.empty())
+      overlaps.push_back(seam.front().overlapCount());
+
+  double predicted = 0;
+  if (!overlaps.empty())
+  {
+    std::nth_element(overlaps.begin(), overlaps.begin() + overlaps.size() / 2, overlaps.end());
+    predicted = overlaps[overlaps.size() / 2];
+  }
+
+  // Every seam offers its candidates and the concatenation
+  std::vector<std::vector<MatchResult>> options(seams);
+  for (std::size_t i = 0; i < seams; ++i)
+  {
+    options[i] = candidates[i];
+    options[i].push_back(MatchResult());
+  }
+
+  // costs[i][k]: least cost of the seams up to i with option k at seam i
+  std::vector<std::vector<double>> costs(seams);
+  std::vector<std::vector<std::size_t>> previous(seams);
+
+  for (std::size_t i = 0; i < seams; ++i)
+  {
+    costs[i].assign(options[i].size(), std::numeric_limits<double>::infinity());
+    previous[i].assign(options[i].size(), 0);
+
+    for (std::size_t k = 0; k < options[i].size(); ++k)
+    {
+      const MatchResult& option = options[i][k];
+      // Concatenating costs as much as a match of no quota at all
+      double own = option.patternFound ? 1.0 - option.quota() + overlapPenalty(option, predicted) : 1.0;
+
+      if (i == 0)
+      {
+        costs[i][k] = own;
+        continue;
+      }
+
+      for (std::size_t l = 0; l < options[i-1].size(); ++l)
+      {
+        const MatchResult& before = options[i-1][l];
+        double transition = option.patternFound && before.patternFound ?
+                            overlapPenalty(option, before.overlapCount()) : 0.0;
+        double cost = costs[i-1][l] + own + transition;
+
+        if (cost < costs[i][k])
+        {
+          costs[i][k] = cost;
+          previous[i][k] = l;
+        }
+      }
+    }
+  }
+
+  // Trace the cheapest chain back from the last seam
+  std::vector<MatchResult> chosen(seams);
+  if (seams == 0)
+    return chosen;
+
+  std::size_t k = std::min_element(costs.back().begin(), costs.back().end()) - costs.back().begin();
+  for (std::size_t i = seams; i-- > 0;)
+  {
+    chosen[i] = options[i][k];
+    k = previous[i][k];
+  }
+
+  return chosen;
+}
@@ -0,0 +1,22 @@
+#ifndef CONSISTENCY_H
+#define CONSISTENCY_H
+
+#include <vector>
+
+#include "binmerge.h"
+
+/******************************************************************************/
+
+// Chooses one of the candidates of every seam (see analyzeSeam()) such that
+// the chain as a whole is most consistent. Each candidate costs what its
+// quota falls short of 100%, plus a penalty for an overlap deviating from the
+// predicted one (the median overlap of the best candidates) and from the
+// overlap chosen at the previous seam, both by their ratio. Recorders tend to
+// overlap their segments by about the same amount, so among matches of
+// similar quota (e.g. in repetitive data), the one fitting its neighbours
+// wins; a clearly better quota still prevails. The minimum total cost is
+// found by dynamic programming over the seams. Concatenating is an option at
+// every seam, costing as much as a match of 0% quota.
+std::vector<MatchResult> chooseConsistentSeams(const std::vector<std::vector<MatchResult>>& candidates);
+
+#endif // CONSISTENCY_H
@@ -0,0 +1,284 @@
+#include "copy.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <thread>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/******************************************************************************/
+
+namespace
+{
+  constexpr std::uint64_t blockSize = 8 << 20;
+  constexpr std::uint64_t dropSize = 64 << 20; // smallest output dropped from the page cache
+
+  // Part of an extent that is copied by a single worker
+  struct Block
+  {
+    std::size_t extent;
+    std::uint64_t offset; // relative to the start of the extent
+    std::uint64_t length;
+  };
+
+  // Lets the kernel copy a range between two files, returns false if that is
+  // not possible (old kernel or C library, different file systems, ...)
+  bool copyOffloaded(int input, std::uint64_t inputOffset,
+                     int output, std::uint64_t outputOffset, std::uint64_t length)
+  {
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 27))
+    loff_t in = inputOffset, out = outputOffset;
+
+    while (length > 0)
+    {
+      ssize_t bytesCopied = copy_file_range(input, &in, output, &out, length, 0);
+      if (bytesCopied <= 0)
+        return false;
+
+      length -= bytesCopied;
+    }
+
+    return true;
+#else
+    errno = ENOSYS;
+    return false;
+#endif
+  }
+
+  // memcpy() with non-temporal stores: the output goes to memory without
+  // evicting the inputs (and everything else) from the CPU caches
+  void streamCopy(unsigned char* destination, const unsigned char* source, std::size_t length)
+  {
+#ifdef __SSE2__
+    std::size_t head = std::min(length, (16 - reinterpret_cast<std::uintptr_t>(destination) % 16) % 16);
+    std::memcpy(destination, source, head);
+    destination += head;
+    source += head;
+    length -= head;
+
+    for (; length >= 64; length -= 64, destination += 64, source += 64)
+    {
+      __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(source));
+      __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(source + 16));
+      __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(source + 32));
+      __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(source + 48));
+      _mm_stream_si128(reinterpret_cast<__m128i*>(destination), a);
+      _mm_stream_si128(reinterpret_cast<__m128i*>(destination + 16), b);
+      _mm_stream_si128(reinterpret_cast<__m128i*>(destination + 32), c);
+      _mm_stream_si128(reinterpret_cast<__m128i*>(destination + 48), d);
+    }
+
+    _mm_sfence();
+#endif
+    std::memcpy(destination, source, length);
+  }
+
+  // Faults a range of a writable mapping in at once, which is much cheaper
+  // than one page at a time while copying. Returns false if the pages cannot
+  // be provided (a kernel without MADV_POPULATE_WRITE is no reason to stop).
+  bool populate(unsigned char* map, std::uint64_t offset, std::uint64_t length)
+  {
+#ifdef MADV_POPULATE_WRITE
+    std::uint64_t pageSize = sysconf(_SC_PAGESIZE);
+    std::uint64_t start = offset / pageSize * pageSize;
+    return madvise(map + start, length + (offset - start), MADV_POPULATE_WRITE) == 0 || errno == EINVAL;
+#else
+    return true;
+#endif
+  }
+
+  // Starts writing a range of the output back to the disk, so that there is
+  // little left to wait for at the end
+  void startWriteback(int output, std::uint64_t offset, std::uint64_t length)
+  {
+#ifdef SYNC_FILE_RANGE_WRITE
+    sync_file_range(output, offset, length, SYNC_FILE_RANGE_WRITE);
+#endif
+  }
+}
+
+/******************************************************************************/
+
+bool copyExtents(const std::vector<std::string>& fileNames,
+                 const std::vector<Extent>& extents,
+                 const std::string& outputFileName,
+                 unsigned threads, std::size_t maxOpen)
+{
+  std::uint64_t outputSize = extents.empty() ? 0 : extents.back().outputOffset + extents.back().length;
+
+  // Every input is opened (and possibly mapped) once for all workers, so
+  // there must not be more of them than may be open at once
+  std::vector<char> used(fileNames.size(), false);
+  for (const auto& extent : extents)
+    if (extent.length > 0)
+      used[extent.file] = true;
+
+  if (static_cast<std::size_t>(std::count(used.begin(), used.end(), true)) > maxOpen)
+    return false;
+
+  std::vector<int> inputs(fileNames.size(), -1);
+  std::vector<std::uint64_t> inputSizes(fileNames.size(), 0);
+  bool failed = false;
+
+  for (std::size_t i = 0; i < fileNames.size(); ++i)
+  {
+    if (!used[i])
+      continue;
+
+    int input = open(fileNames[i].c_str(), O_RDONLY | O_CLOEXEC);
+    struct stat inputInfo;
+
+    if (input < 0 || fstat(input, &inputInfo) != 0)
+    {
+      failed = true;
+      if (input >= 0)
+        close(input);
+      break;
+    }
+
+    inputs[i] = input;
+    inputSizes[i] = inputInfo.st_size;
+  }
+
+  // Inputs that shrank since the analysis cannot be mapped safely
+  for (const auto& extent : extents)
+    if (extent.length > 0 && inputSizes[extent.file] < extent.sourceOffset + extent.length)
+      failed = true;
+
+  // The output is only touched once the inputs are ready
+  int output = failed ? -1 : open(outputFileName.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+
+  // Allocating the space at once keeps the output contiguous
+  struct stat info;
+  if (output < 0 || fstat(output, &info) != 0 || !S_ISREG(info.st_mode) || ftruncate(output, outputSize) != 0)
+  {
+    for (auto input : inputs)
+      if (input >= 0)
+        close(input);
+    if (output >= 0)
+      close(output);
+    return false;
+  }
+
+  // Writing to a mapping of a sparse file dies with SIGBUS once the disk is
+  // full, so mapping the output requires its blocks to be allocated
+  bool allocated = outputSize == 0;
+#ifdef FALLOC_FL_KEEP_SIZE
+  allocated = allocated || fallocate(output, 0, 0, outputSize) == 0;
+#endif
+
+  std::vector<Block> blocks;
+  for (std::size_t i = 0; i < extents.size(); ++i)
+    for (std::uint64_t offset = 0; offset < extents[i].length; offset += blockSize)
+      blocks.push_back(Block{i, offset, std::min(blockSize, extents[i].length - offset)});
+
+  // The first block shows whether the kernel can do the copying
+  bool offloaded = !failed && !blocks.empty() &&
+    copyOffloaded(inputs[extents[blocks[0].extent].file], extents[blocks[0].extent].sourceOffset,
+                  output, extents[blocks[0].extent].outputOffset, blocks[0].length);
+
+  // Otherwise all files are mapped as a whole
+  unsigned char* outputMap = nullptr;
+  std::vector<const unsigned char*> inputMaps(fileNames.size(), nullptr);
+
+  if (!offloaded && !allocated)
+    failed = true;
+
+  if (!failed && !offloaded && outputSize > 0)
+  {
+    void* map = mmap(nullptr, outputSize, PROT_READ | PROT_WRITE, MAP_SHARED, output, 0);
+    failed = map == MAP_FAILED;
+    outputMap = failed ? nullptr : static_cast<unsigned char*>(map);
+
+    for (std::size_t i = 0; i < inputs.size() && !failed; ++i)
+    {
+      if (inputs[i] < 0 || inputSizes[i] == 0)
+        continue;
+
+      map = mmap(nullptr, inputSizes[i], PROT_READ, MAP_SHARED, inputs[i], 0);
+      if (map == MAP_FAILED)
+        failed = true;
+      else
+      {
+        inputMaps[i] = static_cast<const unsigned char*>(map);
+        madvise(map, inputSizes[i], MADV_SEQUENTIAL);
+      }
+    }
+  }
+
+  std::atomic<std::size_t> nextBlock(offloaded ? 1 : 0);
+  std::atomic<bool> copyFailed(failed);
+
+  auto worker = [&]
+  {
+    for (std::size_t b; !copyFailed && (b = nextBlock++) < blocks.size();)
+    {
+      const Block& block = blocks[b];
+      const Extent& extent = extents[block.extent];
+      std::uint64_t outputOffset = extent.outputOffset + block.offset;
+
+      if (offloaded)
+      {
+        if (!copyOffloaded(inputs[extent.file], extent.sourceOffset + block.offset,
+                           output, outputOffset, block.length))
+          copyFailed = true;
+      }
+      else
+      {
+        if (!populate(outputMap, outputOffset, block.length))
+        {
+          copyFailed = true;
+          break;
+        }
+
+        streamCopy(outputMap + outputOffset,
+                   inputMaps[extent.file] + extent.sourceOffset + block.offset, block.length);
+      }
+
+      if (outputSize >= dropSize)
+        startWriteback(output, outputOffset, block.length);
+    }
+  };
+
+  std::vector<std::thread> workers;
+  for (unsigned t = 1; t < threads && !copyFailed; ++t)
+    workers.emplace_back(worker);
+
+  worker();
+
+  for (auto& thread : workers)
+    thread.join();
+
+  failed = copyFailed;
+
+  if (outputMap)
+    munmap(outputMap, outputSize);
+
+  for (std::size_t i = 0; i < inputs.size(); ++i)
+  {
+    if (inputMaps[i])
+      munmap(const_cast<unsigned char*>(inputMaps[i]), inputSizes[i]);
+    if (inputs[i] >= 0)
+      close(inputs[i]);
+  }
+
+  // Once written, the output's pages can go. The inputs are left alone, they
+  // were likely cached before. Small outputs are not worth waiting for.
+  if (!failed && outputSize >= dropSize)
+  {
+    failed = fdatasync(output) != 0;
+    posix_fadvise(output, 0, 0, POSIX_FADV_DONTNEED);
+  }
+
+  return close(output) == 0 && !failed;
+}
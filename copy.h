@@ -0,0 +1,27 @@
+#ifndef COPY_H
+#define COPY_H
+
+#include <string>
+#include <vector>
+
+#include "binmerge.h"
+
+/******************************************************************************/
+
+// Writes the extents straight into a plain output file on several threads,
+// for merges in which nothing else (checksums, index, ...) needs the data.
+// The output is sized up front. Ranges are copied by the kernel
+// (copy_file_range) if the file systems allow; otherwise the files are
+// mapped and copied with non-temporal stores. Either way, a large output is
+// flushed and dropped from the page cache at the end.
+// The output is only mapped if its space could be allocated up front.
+// All inputs are open at the same time; with more than maxOpen of them,
+// false is returned before the output is touched. Returns false as well if
+// neither way works (e.g. the output is not a regular file); the output is
+// then left in an undefined state.
+bool copyExtents(const std::vector<std::string>& fileNames,
+                 const std::vector<Extent>& extents,
+                 const std::string& outputFileName,
+                 unsigned threads, std::size_t maxOpen);
+
+#endif // COPY_H
@@ -0,0 +1,704 @@
+#include "digest.h"
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <thread>
+
+/******************************************************************************/
+
+namespace
+{
+  std::uint32_t readLE32(const unsigned char* p)
+  {
+    return std::uint32_t(p[0]) | std::uint32_t(p[1]) << 8 |
+           std::uint32_t(p[2]) << 16 | std::uint32_t(p[3]) << 24;
+  }
+
+  std::uint64_t readLE64(const unsigned char* p)
+  {
+    return std::uint64_t(readLE32(p)) | std::uint64_t(readLE32(p + 4)) << 32;
+  }
+
+  std::uint32_t rotr32(std::uint32_t x, int n) { return (x >> n) | (x << (32 - n)); }
+  std::uint64_t rotl64(std::uint64_t x, int n) { return (x << n) | (x >> (64 - n)); }
+
+  std::string toHex(const unsigned char* data, std::size_t size)
+  {
+    static const char digits[] = "0123456789abcdef";
+
+    std::string hex;
+    for (std::size_t i = 0; i < size; ++i)
+    {
+      hex += digits[data[i] >> 4];
+      hex += digits[data[i] & 15];
+    }
+    return hex;
+  }
+}
+
+/******************************************************************************/
+
+namespace
+{
+  // SHA-256 according to FIPS 180-4
+  class Sha256 : public Digest
+  {
+  public:
+    void update(const unsigned char* data, std::size_t size) override
+    {
+      totalLength += size;
+
+      while (size > 0)
+      {
+        std::size_t bytes = std::min(size, block.size() - blockSize);
+        std::memcpy(&block[blockSize], data, bytes);
+        blockSize += bytes;
+        data += bytes;
+        size -= bytes;
+
+        if (blockSize == block.size())
+        {
+          compress(block.data());
+          blockSize = 0;
+        }
+      }
+    }
+
+    std::string hexDigest() override
+    {
+      // Append padding and message length in bits
+      std::uint64_t bits = totalLength * 8;
+      unsigned char padding[72] = {0x80};
+      std::size_t paddingSize = (blockSize < 56 ? 56 : 120) - blockSize;
+
+      for (int i = 0; i < 8; ++i)
+        padding[paddingSize + i] = static_cast<unsigned char>(bits >> (56 - 8 * i));
+
+      update(padding, paddingSize + 8);
+
+      unsigned char digest[32];
+      for (int i = 0; i < 32; ++i)
+        digest[i] = static_cast<unsigned char>(state[i / 4] >> (24 - 8 * (i % 4)));
+
+      return toHex(digest, sizeof(digest));
+    }
+
+    std::string checkLine(const std::string& fileName, const std::string& digest) const override
+    {
+      return "SHA256 (" + fileName + ") = " + digest;
+    }
+
+    std::string extension() const override { return ".sha256"; }
+
+  private:
+    void compress(const unsigned char* data)
+    {
+      static const std::uint32_t k[64] = {
+        0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+        0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+        0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+        0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+        0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+        0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+        0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+        0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+      };
+
+      std::uint32_t w[64];
+      for (int i = 0; i < 16; ++i)
+        w[i] = std::uint32_t(data[4*i]) << 24 | std::uint32_t(data[4*i+1]) << 16 |
+               std::uint32_t(data[4*i+2]) << 8 | std::uint32_t(data[4*i+3]);
+
+      for (int i = 16; i < 64; ++i)
+      {
+        std::uint32_t s0 = rotr32(w[i-15], 7) ^ rotr32(w[i-15], 18) ^ (w[i-15] >> 3);
+        std::uint32_t s1 = rotr32(w[i-2], 17) ^ rotr32(w[i-2], 19) ^ (w[i-2] >> 10);
+        w[i] = w[i-16] + s0 + w[i-7] + s1;
+      }
+
+      std::uint32_t a = state[0], b = state[1], c = state[2], d = state[3],
+                    e = state[4], f = state[5], g = state[6], h = state[7];
+
+      for (int i = 0; i < 64; ++i)
+      {
+        std::uint32_t t1 = h + (rotr32(e, 6) ^ rotr32(e, 11) ^ rotr32(e, 25)) +
+                           ((e & f) ^ (~e & g)) + k[i] + w[i];
+        std::uint32_t t2 = (rotr32(a, 2) ^ rotr32(a, 13) ^ rotr32(a, 22)) +
+                           ((a & b) ^ (a & c) ^ (b & c));
+        h = g; g = f; f = e; e = d + t1;
+        d = c; c = b; b = a; a = t1 + t2;
+      }
+
+      state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+      state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+    }
+
+    std::uint32_t state[8] = {
+      0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+    };
+    std::array<unsigned char, 64> block;
+    std::size_t blockSize = 0;
+    std::uint64_t totalLength = 0;
+  };
+}
+
+/******************************************************************************/
+
+namespace
+{
+  // XXH3 (64 bit variant, seed 0, default secret) compatible with "xxhsum -H3"
+  class Xxh3 : public Digest
+  {
+  public:
+    void update(const unsigned char* data, std::size_t size) override
+    {
+      // Short inputs are hashed differently, so keep the beginning around
+      if (totalLength < sizeof(head))
+        std::memcpy(head + totalLength, data, std::min<std::size_t>(size, sizeof(head) - totalLength));
+
+      totalLength += size;
+
+      // A stripe is only consumed when at least one more byte follows it
+      while (size > 0)
+      {
+        if (pendingSize == stripeLength)
+        {
+          consumeStripe(pending);
+          std::memcpy(lastStripe, pending, stripeLength);
+          pendingSize = 0;
+        }
+
+        if (pendingSize == 0 && size > stripeLength)
+        {
+          while (size > stripeLength)
+          {
+            consumeStripe(data);
+            data += stripeLength;
+            size -= stripeLength;
+          }
+          std::memcpy(lastStripe, data - stripeLength, stripeLength);
+        }
+
+        std::size_t bytes = std::min(size, stripeLength - pendingSize);
+        std::memcpy(pending + pendingSize, data, bytes);
+        pendingSize += bytes;
+        data += bytes;
+        size -= bytes;
+      }
+    }
+
+    std::string hexDigest() override
+    {
+      std::uint64_t hash = totalLength <= sizeof(head) ? hashShort(head, totalLength) : hashLong();
+
+      unsigned char canonical[8];
+      for (int i = 0; i < 8; ++i)
+        canonical[i] = static_cast<unsigned char>(hash >> (56 - 8 * i));
+
+      return toHex(canonical, sizeof(canonical));
+    }
+
+    std::string checkLine(const std::string& fileName, const std::string& digest) const override
+    {
+      return "XXH3 (" + fileName + ") = " + digest;
+    }
+
+    std::string extension() const override { return ".xxh3"; }
+
+  private:
+    static constexpr std::size_t stripeLength = 64;
+    static constexpr std::size_t stripesPerBlock = (192 - stripeLength) / 8;
+
+    static constexpr std::uint32_t prime32_1 = 0x9E3779B1U;
+    static constexpr std::uint32_t prime32_2 = 0x85EBCA77U;
+    static constexpr std::uint32_t prime32_3 = 0xC2B2AE3DU;
+    static constexpr std::uint64_t prime64_1 = 0x9E3779B185EBCA87ULL;
+    static constexpr std::uint64_t prime64_2 = 0xC2B2AE3D27D4EB4FULL;
+    static constexpr std::uint64_t prime64_3 = 0x165667B19E3779F9ULL;
+    static constexpr std::uint64_t prime64_4 = 0x85EBCA77C2B2AE63ULL;
+    static constexpr std::uint64_t prime64_5 = 0x27D4EB2F165667C5ULL;
+
+    static const unsigned char secret[192];
+
+    static std::uint64_t mulFold64(std::uint64_t a, std::uint64_t b)
+    {
+      unsigned __int128 product = static_cast<unsigned __int128>(a) * b;
+      return static_cast<std::uint64_t>(product) ^ static_cast<std::uint64_t>(product >> 64);
+    }
+
+    static std::uint64_t xxh64Avalanche(std::uint64_t h)
+    {
+      h ^= h >> 33; h *= prime64_2;
+      h ^= h >> 29; h *= prime64_3;
+      return h ^ (h >> 32);
+    }
+
+    static std::uint64_t avalanche(std::uint64_t h)
+    {
+      h ^= h >> 37; h *= 0x165667919E3779F9ULL;
+      return h ^ (h >> 32);
+    }
+
+    static std::uint64_t rrmxmx(std::uint64_t h, std::uint64_t length)
+    {
+      h ^= rotl64(h, 49) ^ rotl64(h, 24);
+      h *= 0x9FB21C651E98DF25ULL;
+      h ^= (h >> 35) + length;
+      h *= 0x9FB21C651E98DF25ULL;
+      return h ^ (h >> 28);
+    }
+
+    static std::uint64_t mix16(const unsigned char* data, const unsigned char* key)
+    {
+      return mulFold64(readLE64(data) ^ readLE64(key), readLE64(data + 8) ^ readLE64(key + 8));
+    }
+
+    static std::uint64_t hashShort(const unsigned char* data, std::size_t length)
+    {
+      if (length == 0)
+        return xxh64Avalanche(readLE64(secret + 56) ^ readLE64(secret + 64));
+
+      if (length <= 3)
+      {
+        std::uint32_t combined = std::uint32_t(data[0]) << 16 | std::uint32_t(data[length >> 1]) << 24 |
+                                 std::uint32_t(data[length - 1]) | std::uint32_t(length) << 8;
+        return xxh64Avalanche(combined ^ std::uint64_t(readLE32(secret) ^ readLE32(secret + 4)));
+      }
+
+      if (length <= 8)
+      {
+        std::uint64_t input = readLE32(data + length - 4) + (std::uint64_t(readLE32(data)) << 32);
+        return rrmxmx(input ^ (readLE64(secret + 8) ^ readLE64(secret + 16)), length);
+      }
+
+      if (length <= 16)
+      {
+        std::uint64_t low  = readLE64(data) ^ (readLE64(secret + 24) ^ readLE64(secret + 32));
+        std::uint64_t high = readLE64(data + length - 8) ^ (readLE64(secret + 40) ^ readLE64(secret + 48));
+        return avalanche(length + __builtin_bswap64(low) + high + mulFold64(low, high));
+      }
+
+      std::uint64_t acc = length * prime64_1;
+
+      if (length <= 128)
+      {
+        if (length > 32)
+        {
+          if (length > 64)
+          {
+            if (length > 96)
+            {
+              acc += mix16(data + 48, secret + 96);
+              acc += mix16(data + length - 64, secret + 112);
+            }
+            acc += mix16(data + 32, secret + 64);
+            acc += mix16(data + length - 48, secret + 80);
+          }
+          acc += mix16(data + 16, secret + 32);
+          acc += mix16(data + length - 32, secret + 48);
+        }
+        acc += mix16(data, secret);
+        acc += mix16(data + length - 16, secret + 16);
+        return avalanche(acc);
+      }
+
+      for (std::size_t i = 0; i < 8; ++i)
+        acc += mix16(data + 16 * i, secret + 16 * i);
+
+      acc = avalanche(acc);
+
+      for (std::size_t i = 8; i < length / 16; ++i)
+        acc += mix16(data + 16 * i, secret + 16 * (i - 8) + 3);
+
+      acc += mix16(data + length - 16, secret + 136 - 17);
+      return avalanche(acc);
+    }
+
+    static void accumulate(std::uint64_t* acc, const unsigned char* data, const unsigned char* key)
+    {
+      for (int i = 0; i < 8; ++i)
+      {
+        std::uint64_t value = readLE64(data + 8 * i);
+        std::uint64_t keyed = value ^ readLE64(key + 8 * i);
+        acc[i ^ 1] += value;
+        acc[i] += (keyed & 0xFFFFFFFF) * (keyed >> 32);
+      }
+    }
+
+    void consumeStripe(const unsigned char* data)
+    {
+      accumulate(acc, data, secret + 8 * stripesInBlock);
+
+      if (++stripesInBlock == stripesPerBlock)
+      {
+        // Scramble accumulators at the end of every block
+        for (int i = 0; i < 8; ++i)
+        {
+          std::uint64_t a = acc[i];
+          a ^= a >> 47;
+          a ^= readLE64(secret + 192 - stripeLength + 8 * i);
+          acc[i] = a * prime32_1;
+        }
+        stripesInBlock = 0;
+      }
+    }
+
+    std::uint64_t hashLong()
+    {
+      // The final stripe consists of the last 64 input bytes
+      unsigned char stripe[stripeLength];
+      std::size_t catchUp = stripeLength - pendingSize;
+      std::memcpy(stripe, lastStripe + stripeLength - catchUp, catchUp);
+      std::memcpy(stripe + catchUp, pending, pendingSize);
+
+      std::uint64_t final[8];
+      std::copy(acc, acc + 8, final);
+      accumulate(final, stripe, secret + 192 - stripeLength - 7);
+
+      std::uint64_t result = totalLength * prime64_1;
+      for (int i = 0; i < 4; ++i)
+        result += mulFold64(final[2*i] ^ readLE64(secret + 11 + 16 * i),
+                            final[2*i+1] ^ readLE64(secret + 11 + 16 * i + 8));
+
+      return avalanche(result);
+    }
+
+    std::uint64_t acc[8] = {
+      prime32_3, prime64_1, prime64_2, prime64_3, prime64_4, prime32_2, prime64_5, prime32_1
+    };
+    std::size_t stripesInBlock = 0;
+    std::uint64_t totalLength = 0;
+
+    unsigned char head[240];
+    unsigned char pending[stripeLength];
+    unsigned char lastStripe[stripeLength];
+    std::size_t pendingSize = 0;
+  };
+
+  const unsigned char Xxh3::secret[192] = {
+    0xb8, 0xfe, 0x6c, 0x39, 0x23, 0xa4, 0x4b, 0xbe, 0x7c, 0x01, 0x81, 0x2c, 0xf7, 0x21, 0xad, 0x1c,
+    0xde, 0xd4, 0x6d, 0xe9, 0x83, 0x90, 0x97, 0xdb, 0x72, 0x40, 0xa4, 0xa4, 0xb7, 0xb3, 0x67, 0x1f,
+    0xcb, 0x79, 0xe6, 0x4e, 0xcc, 0xc0, 0xe5, 0x78, 0x82, 0x5a, 0xd0, 0x7d, 0xcc, 0xff, 0x72, 0x21,
+    0xb8, 0x08, 0x46, 0x74, 0xf7, 0x43, 0x24, 0x8e, 0xe0, 0x35, 0x90, 0xe6, 0x81, 0x3a, 0x26, 0x4c,
+    0x3c, 0x28, 0x52, 0xbb, 0x91, 0xc3, 0x00, 0xcb, 0x88, 0xd0, 0x65, 0x8b, 0x1b, 0x53, 0x2e, 0xa3,
+    0x71, 0x64, 0x48, 0x97, 0xa2, 0x0d, 0xf9, 0x4e, 0x38, 0x19, 0xef, 0x46, 0xa9, 0xde, 0xac, 0xd8,
+    0xa8, 0xfa, 0x76, 0x3f, 0xe3, 0x9c, 0x34, 0x3f, 0xf9, 0xdc, 0xbb, 0xc7, 0xc7, 0x0b, 0x4f, 0x1d,
+    0x8a, 0x51, 0xe0, 0x4b, 0xcd, 0xb4, 0x59, 0x31, 0xc8, 0x9f, 0x7e, 0xc9, 0xd9, 0x78, 0x73, 0x64,
+    0xea, 0xc5, 0xac, 0x83, 0x34, 0xd3, 0xeb, 0xc3, 0xc5, 0x81, 0xa0, 0xff, 0xfa, 0x13, 0x63, 0xeb,
+    0x17, 0x0d, 0xdd, 0x51, 0xb7, 0xf0, 0xda, 0x49, 0xd3, 0x16, 0x55, 0x26, 0x29, 0xd4, 0x68, 0x9e,
+    0x2b, 0x16, 0xbe, 0x58, 0x7d, 0x47, 0xa1, 0xfc, 0x8f, 0xf8, 0xb8, 0xd1, 0x7a, 0xd0, 0x31, 0xce,
+    0x45, 0xcb, 0x3a, 0x8f, 0x95, 0x16, 0x04, 0x28, 0xaf, 0xd7, 0xfb, 0xca, 0xbb, 0x4b, 0x40, 0x7e,
+  };
+}
+
+/******************************************************************************/
+
+namespace
+{
+  // BLAKE3 (unkeyed, 256 bit output) compatible with "b3sum". Complete
+  // subtrees of the hash tree are independent of each other, so large inputs
+  // are split into such subtrees that are hashed on several threads.
+  class Blake3 : public Digest
+  {
+  public:
+    Blake3()
+      : threads(std::max(1u, std::min(8u, std::thread::hardware_concurrency())))
+    {
+    }
+
+    void update(const unsigned char* data, std::size_t size) override
+    {
+      pending.insert(pending.end(), data, data + size);
+
+      // Hash a batch of subtrees once at least one more byte follows it
+      const std::size_t batchSize = threads * subtreeSize;
+      if (pending.size() - pendingStart <= batchSize)
+        return;
+
+      ChainingValue results[16];
+      std::vector<std::thread> workers;
+
+      for (unsigned t = 1; t < threads; ++t)
+        workers.emplace_back([this, t, &results]
+        {
+          results[t] = hashSubtree(&pending[pendingStart + t * subtreeSize],
+                                   subtreeSize / chunkLength, chunkCounter + t * (subtreeSize / chunkLength));
+        });
+
+      results[0] = hashSubtree(&pending[pendingStart], subtreeSize / chunkLength, chunkCounter);
+
+      for (auto& worker : workers)
+        worker.join();
+
+      for (unsigned t = 0; t < threads; ++t)
+      {
+        pushChainingValue(results[t]);
+        chunkCounter += subtreeSize / chunkLength;
+      }
+
+      pendingStart += batchSize;
+
+      // Drop consumed input once in a while
+      if (pendingStart >= batchSize * 4)
+      {
+        pending.erase(pending.begin(), pending.begin() + pendingStart);
+        pendingStart = 0;
+      }
+    }
+
+    std::string hexDigest() override
+    {
+      // All complete chunks but the last one are pushed on the stack
+      const unsigned char* data = pending.data() + pendingStart;
+      std::size_t size = pending.size() - pendingStart;
+
+      while (size > chunkLength)
+      {
+        pushChainingValue(chunkOutput(data, chunkLength, chunkCounter).chainingValue());
+        ++chunkCounter;
+        data += chunkLength;
+        size -= chunkLength;
+      }
+
+      // The remaining chunk is combined with the stack up to the root
+      mergeStack(chunkCounter);
+      Output output = chunkOutput(data, size, chunkCounter);
+
+      while (!stack.empty())
+      {
+        output = parentOutput(stack.back(), output.chainingValue());
+        stack.pop_back();
+      }
+
+      output.flags |= root;
+      ChainingValue hash = output.compress();
+
+      unsigned char digest[32];
+      for (int i = 0; i < 32; ++i)
+        digest[i] = static_cast<unsigned char>(hash[i / 4] >> (8 * (i % 4)));
+
+      return toHex(digest, sizeof(digest));
+    }
+
+    std::string checkLine(const std::string& fileName, const std::string& digest) const override
+    {
+      return digest + "  " + fileName;
+    }
+
+    std::string extension() const override { return ".b3"; }
+
+  private:
+    using ChainingValue = std::array<std::uint32_t, 8>;
+
+    static constexpr std::size_t blockLength = 64;
+    static constexpr std::size_t chunkLength = 1024;
+    static constexpr std::size_t subtreeSize = 1 << 20; // has to be a power of two
+
+    enum Flags : std::uint32_t { chunkStart = 1, chunkEnd = 2, parent = 4, root = 8 };
+
+    static constexpr std::uint32_t iv[8] = {
+      0x6A09E667, 0xBB67AE85, 0x3C6EF372, 0xA54FF53A, 0x510E527F, 0x9B05688C, 0x1F83D9AB, 0x5BE0CD19
+    };
+
+    static void g(std::uint32_t* s, int a, int b, int c, int d, std::uint32_t x, std::uint32_t y)
+    {
+      s[a] = s[a] + s[b] + x; s[d] = rotr32(s[d] ^ s[a], 16);
+      s[c] = s[c] + s[d];     s[b] = rotr32(s[b] ^ s[c], 12);
+      s[a] = s[a] + s[b] + y; s[d] = rotr32(s[d] ^ s[a], 8);
+      s[c] = s[c] + s[d];     s[b] = rotr32(s[b] ^ s[c], 7);
+    }
+
+    // Input of a compression whose result is not known to be the root yet
+    struct Output
+    {
+      ChainingValue chaining;
+      std::uint32_t block[16];
+      std::uint64_t counter;
+      std::uint32_t blockLength;
+      std::uint32_t flags;
+
+      ChainingValue compress() const
+      {
+        static const int permutation[16] = {2, 6, 3, 10, 7, 0, 4, 13, 1, 11, 12, 5, 9, 14, 15, 8};
+
+        std::uint32_t s[16] = {
+          chaining[0], chaining[1], chaining[2], chaining[3],
+          chaining[4], chaining[5], chaining[6], chaining[7],
+          iv[0], iv[1], iv[2], iv[3],
+          static_cast<std::uint32_t>(counter), static_cast<std::uint32_t>(counter >> 32),
+          blockLength, flags
+        };
+
+        std::uint32_t m[16];
+        std::copy(block, block + 16, m);
+
+        for (int round = 0; round < 7; ++round)
+        {
+          g(s, 0, 4,  8, 12, m[0],  m[1]);
+          g(s, 1, 5,  9, 13, m[2],  m[3]);
+          g(s, 2, 6, 10, 14, m[4],  m[5]);
+          g(s, 3, 7, 11, 15, m[6],  m[7]);
+          g(s, 0, 5, 10, 15, m[8],  m[9]);
+          g(s, 1, 6, 11, 12, m[10], m[11]);
+          g(s, 2, 7,  8, 13, m[12], m[13]);
+          g(s, 3, 4,  9, 14, m[14], m[15]);
+
+          std::uint32_t permuted[16];
+          for (int i = 0; i < 16; ++i)
+            permuted[i] = m[permutation[i]];
+          std::copy(permuted, permuted + 16, m);
+        }
+
+        ChainingValue result;
+        for (int i = 0; i < 8; ++i)
+          result[i] = s[i] ^ s[i + 8];
+        return result;
+      }
+
+      ChainingValue chainingValue() const { return compress(); }
+    };
+
+    static Output chunkOutput(const unsigned char* data, std::size_t size, std::uint64_t counter)
+    {
+      Output output;
+      std::copy(iv, iv + 8, output.chaining.begin());
+      output.counter = counter;
+
+      // Every block but the last one is compressed right away
+      std::uint32_t flags = chunkStart;
+      while (size > blockLength)
+      {
+        for (int i = 0; i < 16; ++i)
+          output.block[i] = readLE32(data + 4 * i);
+
+        output.blockLength = blockLength;
+        output.flags = flags;
+        output.chaining = output.compress();
+
+        flags = 0;
+        data += blockLength;
+        size -= blockLength;
+      }
+
+      unsigned char last[blockLength] = {};
+      std::copy(data, data + size, last);
+
+      for (int i = 0; i < 16; ++i)
+        output.block[i] = readLE32(last + 4 * i);
+
+      output.blockLength = static_cast<std::uint32_t>(size);
+      output.flags = flags | chunkEnd;
+      return output;
+    }
+
+    static Output parentOutput(const ChainingValue& left, const ChainingValue& right)
+    {
+      Output output;
+      std::copy(iv, iv + 8, output.chaining.begin());
+      std::copy(left.begin(), left.end(), output.block);
+      std::copy(right.begin(), right.end(), output.block + 8);
+      output.counter = 0;
+      output.blockLength = blockLength;
+      output.flags = parent;
+      return output;
+    }
+
+    static ChainingValue hashSubtree(const unsigned char* data, std::size_t chunks, std::uint64_t counter)
+    {
+      std::vector<ChainingValue> level(chunks);
+      for (std::size_t i = 0; i < chunks; ++i)
+        level[i] = chunkOutput(data + i * chunkLength, chunkLength, counter + i).chainingValue();
+
+      for (; chunks > 1; chunks /= 2)
+        for (std::size_t i = 0; i < chunks / 2; ++i)
+          level[i] = parentOutput(level[2*i], level[2*i+1]).chainingValue();
+
+      return level[0];
+    }
+
+    // The stack holds one entry per set bit of the chunk count, merging is
+    // delayed until more input arrives since the last node has to become the root
+    void mergeStack(std::uint64_t chunks)
+    {
+      while (stack.size() > static_cast<std::size_t>(__builtin_popcountll(chunks)))
+      {
+        ChainingValue right = stack.back();
+        stack.pop_back();
+        stack.back() = parentOutput(stack.back(), right).chainingValue();
+      }
+    }
+
+    void pushChainingValue(const ChainingValue& value)
+    {
+      mergeStack(chunkCounter);
+      stack.push_back(value);
+    }
+
+    const unsigned threads;
+    std::vector<unsigned char> pending;
+    std::size_t pendingStart = 0;
+    std::uint64_t chunkCounter = 0;
+    std::vector<ChainingValue> stack;
+  };
+
+  constexpr std::uint32_t Blake3::iv[8];
+}
+
+/******************************************************************************/
+
+std::unique_ptr<Digest> makeDigest(const std::string& name)
+{
+  if (name == "sha256")
+    return std::unique_ptr<Digest>(new Sha256);
+  if (name == "xxh3")
+    return std::unique_ptr<Digest>(new Xxh3);
+  if (name == "blake3")
+    return std::unique_ptr<Digest>(new Blake3);
+
+  return nullptr;
+}
+
+/******************************************************************************/
+
+DigestSink::DigestSink(std::vector<std::unique_ptr<Digest>> digests, const std::vector<std::string>& outputFileNames)
+  : digests(std::move(digests)), outputFileNames(outputFileNames)
+{
+}
+
+void DigestSink::write(const unsigned char* data, std::size_t size)
+{
+  for (auto& digest : digests)
+    digest->update(data, size);
+}
+
+bool DigestSink::finish()
+{
+  bool written = true;
+
+  for (auto& digest : digests)
+  {
+    // Finishing the computation can only be done once
+    std::string hex = digest->hexDigest();
+
+    for (const auto& outputFileName : outputFileNames)
+    {
+      auto sidecarName = outputFileName + digest->extension();
+      std::ofstream sidecar(sidecarName);
+      sidecar << digest->checkLine(getFilename(outputFileName), hex) << '\n';
+
+      if (!sidecar)
+      {
+        std::cerr << "File: " << sidecarName << " failed to open." << '\n';
+        written = false;
+      }
+    }
+  }
+
+  return written;
+}
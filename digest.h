@@ -0,0 +1,51 @@
+#ifndef DIGEST_H
+#define DIGEST_H
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "binmerge.h"
+
+/******************************************************************************/
+
+// Incremental message digest
+class Digest
+{
+public:
+  virtual ~Digest() = default;
+
+  virtual void update(const unsigned char* data, std::size_t size) = 0;
+
+  // Finishes the computation, returns the digest as hex string
+  virtual std::string hexDigest() = 0;
+
+  // Line for the sidecar file in the format its checking tool understands,
+  // given the result of hexDigest()
+  virtual std::string checkLine(const std::string& fileName, const std::string& digest) const = 0;
+
+  // File name extension of the sidecar file
+  virtual std::string extension() const = 0;
+};
+
+// Supported names are "xxh3", "blake3" and "sha256", returns nullptr otherwise
+std::unique_ptr<Digest> makeDigest(const std::string& name);
+
+/******************************************************************************/
+
+// Computes digests of the merged output while it is being written and stores
+// each of them in a sidecar file next to every output ("output.bin.sha256", ...)
+class DigestSink : public MergeSink
+{
+public:
+  DigestSink(std::vector<std::unique_ptr<Digest>> digests, const std::vector<std::string>& outputFileNames);
+
+  void write(const unsigned char* data, std::size_t size) override;
+  bool finish() override;
+
+private:
+  std::vector<std::unique_ptr<Digest>> digests;
+  std::vector<std::string> outputFileNames;
+};
+
+#endif // DIGEST_H
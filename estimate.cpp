@@ -0,0 +1,305 @@
+#include "estimate.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <memory>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/******************************************************************************/
+
+namespace
+{
+  constexpr std::size_t probeSize = 32 << 20;
+  constexpr std::size_t probeChunk = 1 << 20;
+
+  // Reading from the page cache is assumed to be this fast
+  constexpr double cachedReadSpeed = 4.0 * (1 << 30);
+
+  // Buffer sizes of the strategies (see binmerge.cpp, output.cpp, verify.cpp)
+  constexpr std::uint64_t searchBufferSize = 2 * (64 << 10);
+  constexpr std::uint64_t compareBufferSize = 2 * (64 << 10);
+  constexpr std::uint64_t mergeBufferSize = 1 << 20;
+  constexpr std::uint64_t queueSize = 64 << 20;
+  constexpr std::uint64_t frameSize = 4 << 20;
+  constexpr std::uint64_t verifyBlockSize = 4 << 20;
+
+  double secondsSince(std::chrono::steady_clock::time_point start)
+  {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  }
+
+  struct AlignedBuffer
+  {
+    void* data = nullptr;
+
+    explicit AlignedBuffer(std::size_t size)
+    {
+      if (posix_memalign(&data, 4096, size) != 0)
+        data = nullptr;
+    }
+
+    ~AlignedBuffer() { std::free(data); }
+  };
+
+  // Reads a few MiB from the middle of the file, bypassing the page cache if
+  // the file system allows (otherwise the file most likely lives in memory)
+  double probeReadSpeed(const std::string& fileName, std::uint64_t size)
+  {
+    int file = -1;
+#ifdef O_DIRECT
+    file = open(fileName.c_str(), O_RDONLY | O_DIRECT | O_CLOEXEC);
+#endif
+    if (file < 0)
+      file = open(fileName.c_str(), O_RDONLY | O_CLOEXEC);
+    if (file < 0)
+      return 0;
+
+    AlignedBuffer buffer(probeChunk);
+    std::uint64_t offset = size > probeSize ? (size - probeSize) / 2 / 4096 * 4096 : 0;
+    std::uint64_t bytesRead = 0;
+    auto start = std::chrono::steady_clock::now();
+
+    while (buffer.data && bytesRead < probeSize)
+    {
+      ssize_t length = pread(file, buffer.data, probeChunk, offset + bytesRead);
+      if (length <= 0)
+        break;
+      bytesRead += length;
+    }
+
+    double seconds = secondsSince(start);
+    close(file);
+
+    return bytesRead > 0 && seconds > 0 ? bytesRead / seconds : 0;
+  }
+
+  // Whether the output is (or will be) a file of its own, rather than e.g.
+  // /dev/null, next to which nothing should be written
+  bool isRegularOutput(const std::string& outputFileName)
+  {
+    struct stat info;
+    if (stat(outputFileName.c_str(), &info) == 0)
+      return S_ISREG(info.st_mode);
+
+    std::size_t slash = outputFileName.find_last_of('/');
+    std::string directory = slash == std::string::npos ? std::string(".") : outputFileName.substr(0, slash);
+    return stat(directory.c_str(), &info) == 0 && S_ISDIR(info.st_mode) && access(directory.c_str(), W_OK) == 0;
+  }
+
+  // Writes a temporary file next to the output and waits until it is on disk
+  double probeWriteSpeed(const std::string& outputFileName)
+  {
+    std::size_t slash = outputFileName.find_last_of('/');
+    std::string name = (slash == std::string::npos ? std::string(".") : outputFileName.substr(0, slash))
+                       + "/.binmerge-estimate-XXXXXX";
+
+    int file = mkstemp(&name[0]);
+    if (file < 0)
+      return 0;
+
+    // Not all zeros, some file systems compress
+    std::vector<unsigned char> data(probeChunk);
+    for (std::size_t k = 0; k < data.size(); ++k)
+      data[k] = static_cast<unsigned char>(k * 2654435761u >> 13);
+
+    std::uint64_t written = 0;
+    auto start = std::chrono::steady_clock::now();
+
+    while (written < probeSize)
+    {
+      ssize_t length = write(file, data.data(), data.size());
+      if (length <= 0)
+        break;
+      written += length;
+    }
+
+    bool synced = fdatasync(file) == 0;
+    double seconds = secondsSince(start);
+
+    close(file);
+    unlink(name.c_str());
+
+    return synced && written == probeSize && seconds > 0 ? written / seconds : 0;
+  }
+
+  // Time for reading the given bytes, of which the given share is cached
+  double readSeconds(std::uint64_t bytes, double cachedShare, double readSpeed)
+  {
+    double seconds = bytes * cachedShare / cachedReadSpeed;
+    if (readSpeed > 0)
+      seconds += bytes * (1 - cachedShare) / readSpeed;
+    return seconds;
+  }
+}
+
+/******************************************************************************/
+
+JobEstimate estimateJob(InputFiles& inputs, const std::vector<MatchResult>* searchResults,
+                        const std::vector<std::string>& outputFileNames,
+                        const SeamOptions& seamOptions, const MergeOptions& mergeOptions,
+                        bool hasSinks, bool verify)
+{
+  JobEstimate estimate;
+  estimate.files = inputs.size();
+
+  // Cached share per file (compressed files count as not cached)
+  std::vector<double> cachedShares(inputs.size(), 0.0);
+  std::size_t largest = 0;
+
+  for (std::size_t i = 0; i < inputs.size(); ++i)
+  {
+    std::uint64_t cached = inputs.cachedBytes(i, 0, inputs.fileSize(i));
+    estimate.inputBytes += inputs.fileSize(i);
+    estimate.cachedBytes += cached;
+
+    if (inputs.fileSize(i) > 0)
+      cachedShares[i] = static_cast<double>(cached) / inputs.fileSize(i);
+
+    if (inputs.fileSize(i) > inputs.fileSize(largest))
+      largest = i;
+  }
+
+  if (inputs.size() > 0)
+    estimate.readSpeed = probeReadSpeed(inputs.name(largest), inputs.fileSize(largest));
+
+  // With a plan, --verify only checks the outputs and writes nothing
+  estimate.verifyOnly = searchResults && verify;
+
+  for (const auto& outputFileName : outputFileNames)
+  {
+    if (estimate.verifyOnly || !isRegularOutput(outputFileName))
+      continue;
+
+    double speed = probeWriteSpeed(outputFileName);
+    estimate.writeSpeed = estimate.writeSpeed == 0 ? speed : std::min(estimate.writeSpeed, speed);
+  }
+
+  auto readTime = [&](std::size_t i, std::uint64_t bytes)
+  {
+    return readSeconds(bytes, cachedShares[i], estimate.readSpeed);
+  };
+
+  // Analysis: each successor is searched from its head, either found within
+  // the first blocks or not at all (with --ts possibly twice), and the
+  // overlap is compared unless that happens while merging
+  if (!searchResults)
+  {
+    for (std::size_t i = 0; i + 1 < inputs.size(); ++i)
+    {
+      std::uint64_t size1 = inputs.fileSize(i), size2 = inputs.fileSize(i+1);
+      std::uint64_t minimum = seamOptions.patternSize + std::min(size2, searchBufferSize);
+      std::uint64_t search = seamOptions.transportStream ? 2 * size2 : size2;
+      std::uint64_t compare = seamOptions.compare ? std::min(size1, size2) : 0;
+
+      estimate.analysisReadMinimum += minimum;
+      estimate.analysisReadMaximum += seamOptions.patternSize + search + 2 * compare;
+      estimate.analysisSecondsMinimum += readTime(i+1, minimum);
+      estimate.analysisSecondsMaximum += readTime(i+1, search) + readTime(i, compare) + readTime(i+1, compare);
+    }
+  }
+
+  // Merge: the extents of a plan, otherwise at most all of every file
+  std::uint64_t outputSize = 0;
+  double readTimeMerge = 0;
+
+  if (searchResults)
+  {
+    for (const auto& extent : planExtents(inputs.sizes(), *searchResults))
+    {
+      outputSize += extent.length;
+      readTimeMerge += readTime(extent.file, extent.length);
+    }
+  }
+  else
+  {
+    for (std::size_t i = 0; i < inputs.size(); ++i)
+    {
+      outputSize += inputs.fileSize(i);
+      readTimeMerge += readTime(i, inputs.fileSize(i));
+    }
+  }
+
+  estimate.mergeRead = estimate.verifyOnly ? 0 : outputSize;
+
+  // Fused verification reads the overlaps of the successors once more
+  if (mergeOptions.fusedVerification && !estimate.verifyOnly)
+  {
+    for (std::size_t i = 0; i + 1 < inputs.size(); ++i)
+    {
+      std::uint64_t overlap = searchResults ? (*searchResults)[i].overlapCount()
+                                            : std::min(inputs.fileSize(i), inputs.fileSize(i+1));
+      estimate.mergeRead += overlap;
+      readTimeMerge += readTime(i+1, overlap);
+    }
+  }
+
+  // Compressed output is smaller, but by how much is unknown
+  if (!estimate.verifyOnly)
+  {
+    estimate.written = outputSize * outputFileNames.size();
+
+    double writeTime = estimate.writeSpeed > 0 ? outputSize / estimate.writeSpeed : 0;
+    estimate.mergeSeconds = std::max(readTimeMerge, writeTime);
+  }
+
+  // Verification reads every output and all of its sources again
+  if (verify)
+  {
+    std::uint64_t verifyRead = 2 * outputSize * outputFileNames.size();
+    estimate.mergeRead += verifyRead;
+    estimate.mergeSeconds += readSeconds(verifyRead, 0.0, estimate.readSpeed);
+  }
+
+  // Seams within a byte are spliced while streaming; without a plan, --bits may find some
+  bool bitLevel = searchResults ? std::any_of(searchResults->begin(), searchResults->end(),
+                                              [](const MatchResult& result) { return result.bitShift > 0; })
+                                : seamOptions.bitGranular;
+
+  estimate.directCopy = !estimate.verifyOnly && outputFileNames.size() == 1 && !hasSinks &&
+                        !mergeOptions.fusedVerification && !bitLevel && mergeOptions.splitSize == 0 &&
+                        mergeOptions.compressionLevel == 0 && !inputs.anyCompressed() &&
+                        inputs.size() <= mergeOptions.maxOpen;
+
+  // Memory: the phases run one after the other, so the largest one counts
+  std::uint64_t tinyFiles = std::min<std::uint64_t>(inputs.size(), InputFiles::defaultMaxOpen) *
+                            InputFiles::defaultTinySize;
+  std::uint64_t analysisMemory = searchResults ? 0 : searchBufferSize + compareBufferSize + tinyFiles;
+  std::uint64_t mergeMemory = 0;
+
+  if (!estimate.directCopy && !estimate.verifyOnly)
+  {
+    mergeMemory = mergeBufferSize + tinyFiles;
+    if (mergeOptions.fusedVerification)
+      mergeMemory += mergeBufferSize;
+    if (outputFileNames.size() > 1)
+      mergeMemory += queueSize * outputFileNames.size();
+    if (mergeOptions.compressionLevel > 0)
+      mergeMemory += 2 * frameSize * mergeOptions.threads * outputFileNames.size();
+    if (mergeOptions.splitSize > 0 && mergeOptions.packetAligned)
+      mergeMemory += mergeBufferSize * outputFileNames.size();
+  }
+
+  std::uint64_t verifyMemory = verify ? 2 * verifyBlockSize * mergeOptions.threads : 0;
+  estimate.memory = std::max({analysisMemory, mergeMemory, verifyMemory});
+
+  return estimate;
+}
+
+void printEstimate(std::ostream& stream, const JobEstimate& estimate)
+{
+  stream << "binmerge-estimate 1\n"
+         << "inputs " << estimate.files << ' ' << estimate.inputBytes << ' ' << estimate.cachedBytes << '\n'
+         << std::fixed << std::setprecision(0)
+         << "storage " << estimate.readSpeed << ' ' << estimate.writeSpeed << '\n'
+         << std::setprecision(3)
+         << "analysis " << estimate.analysisReadMinimum << ' ' << estimate.analysisReadMaximum << ' '
+         << estimate.analysisSecondsMinimum << ' ' << estimate.analysisSecondsMaximum << '\n'
+         << "merge " << estimate.mergeRead << ' ' << estimate.written << ' ' << estimate.mergeSeconds << '\n'
+         << "memory " << estimate.memory << '\n'
+         << "strategy " << (estimate.verifyOnly ? "verify" : estimate.directCopy ? "direct-copy" : "stream") << '\n';
+}
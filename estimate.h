@@ -0,0 +1,64 @@
+#ifndef ESTIMATE_H
+#define ESTIMATE_H
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "binmerge.h"
+#include "inputs.h"
+
+/******************************************************************************/
+
+// Prediction of what a job costs, made without running it
+struct JobEstimate
+{
+  std::size_t files = 0;
+  std::uint64_t inputBytes = 0;
+  std::uint64_t cachedBytes = 0; // resident in the page cache
+
+  // Measured throughput in bytes per second, 0 if unknown
+  double readSpeed = 0;
+  double writeSpeed = 0;
+
+  // The analysis reads an unknown part of each file until the pattern is
+  // found, hence a range (both 0 when merging according to a plan)
+  std::uint64_t analysisReadMinimum = 0;
+  std::uint64_t analysisReadMaximum = 0;
+  double analysisSecondsMinimum = 0;
+  double analysisSecondsMaximum = 0;
+
+  // Exact with a plan, otherwise upper bounds (overlaps are not known yet)
+  std::uint64_t mergeRead = 0;
+  std::uint64_t written = 0;
+  double mergeSeconds = 0;
+
+  std::uint64_t memory = 0; // peak of the buffers, the page cache aside
+  bool directCopy = false;  // copied by copyExtents(), see mergeFiles()
+  bool verifyOnly = false;  // --verify with a plan, nothing is merged
+};
+
+// Stats the inputs, checks which parts of them are cached, probes the read
+// speed of the largest input and the write speed next to every output that
+// is a regular file (with a temporary file of a few MiB that is removed
+// again), and applies the strategies mergeFiles() and analyzeSeam() would
+// choose. The search results of a plan are used if given (nullptr: to be
+// analyzed); together with verify, only the verification is estimated.
+JobEstimate estimateJob(InputFiles& inputs, const std::vector<MatchResult>* searchResults,
+                        const std::vector<std::string>& outputFileNames,
+                        const SeamOptions& seamOptions, const MergeOptions& mergeOptions,
+                        bool hasSinks, bool verify);
+
+// Prints the estimate as lines of a keyword and numbers, e.g. for schedulers:
+//
+//   binmerge-estimate 1
+//   inputs <files> <bytes> <cached bytes>
+//   storage <read bytes/s> <write bytes/s>
+//   analysis <bytes read min> <bytes read max> <seconds min> <seconds max>
+//   merge <bytes read> <bytes written> <seconds>
+//   memory <bytes>
+//   strategy direct-copy|stream|verify
+void printEstimate(std::ostream& stream, const JobEstimate& estimate);
+
+#endif // ESTIMATE_H
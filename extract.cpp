@@ -0,0 +1,275 @@
+#include "extract.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <sstream>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "ts.h"
+
+/******************************************************************************/
+
+namespace
+{
+  constexpr std::size_t probeSize = 64 << 10;
+  constexpr std::uint64_t probeLimit = 4 << 20; // PCRs are due every 100 ms
+  constexpr std::uint16_t anyPid = 0x2000;
+
+  // Parses [[HH:]MM:]SS[.fraction] into 27 MHz ticks
+  bool parseTime(const std::string& text, std::uint64_t& ticks)
+  {
+    std::istringstream stream(text);
+    std::vector<std::string> fields;
+    for (std::string field; std::getline(stream, field, ':');)
+      fields.push_back(field);
+
+    if (fields.empty() || fields.size() > 3)
+      return false;
+
+    double seconds = 0;
+    for (std::size_t k = 0; k < fields.size(); ++k)
+    {
+      const std::string& field = fields[k];
+      bool last = k + 1 == fields.size();
+      char* end = nullptr;
+
+      if (field.empty() || !std::isdigit(static_cast<unsigned char>(field[0])))
+        return false;
+
+      double value = last ? std::strtod(field.c_str(), &end) : std::strtoul(field.c_str(), &end, 10);
+      if (*end != '\0' || (k > 0 && value >= 60))
+        return false;
+
+      seconds = seconds * 60 + value;
+    }
+
+    ticks = static_cast<std::uint64_t>(std::llround(seconds * pcrTicksPerSecond));
+    return true;
+  }
+
+  struct Pcr
+  {
+    std::uint64_t offset;  // of the packet carrying it
+    std::uint64_t time;    // ticks since the first PCR of the recording
+    std::size_t packetSize;
+  };
+
+  // Finds PCRs of one PID in the files, reading probeSize bytes at a time
+  class PcrProbe
+  {
+  public:
+    PcrProbe() : buffer(new unsigned char[probeSize]) {}
+
+    // First PCR at or behind offset in front of end, looking at most
+    // probeLimit bytes far (the first PCR found fixes PID and origin)
+    bool find(int file, std::uint64_t offset, std::uint64_t end, Pcr& result)
+    {
+      for (std::uint64_t scanned = 0; offset < end && scanned < probeLimit;)
+      {
+        ssize_t bytesRead = pread(file, &buffer[0], std::min<std::uint64_t>(probeSize, end - offset), offset);
+        if (bytesRead <= 0)
+          return false;
+
+        std::size_t length = bytesRead, packetSize, grid, k;
+        std::size_t advance = length > 204 ? length - 204 : length;
+
+        if (findPacketGrid(&buffer[0], length, packetSize, grid))
+        {
+          for (k = grid; k + packetSize <= length; k += packetSize)
+          {
+            const unsigned char* packet = &buffer[k + syncOffset(packetSize)];
+            if (packet[0] != tsSyncByte)
+              break; // lost sync, a new grid is searched behind it
+
+            std::uint64_t value;
+            if (readPcr(packet, value) && (pid == anyPid || packetPid(packet) == pid))
+            {
+              if (pid == anyPid)
+              {
+                pid = packetPid(packet);
+                origin = value;
+              }
+
+              result = Pcr{offset + k, pcrDistance(origin, value), packetSize};
+              return true;
+            }
+          }
+
+          if (k > grid)
+            advance = k;
+        }
+
+        offset += advance;
+        scanned += advance;
+      }
+
+      return false;
+    }
+
+  private:
+    std::unique_ptr<unsigned char[]> buffer;
+    std::uint16_t pid = anyPid;
+    std::uint64_t origin = 0;
+  };
+
+  // Consecutive PCRs of a file around a point in time
+  struct Bracket
+  {
+    Pcr before;          // last PCR at or in front of the time
+    std::uint64_t after; // offset of the next PCR (file size if none)
+  };
+
+  Bracket bisect(PcrProbe& probe, int file, std::uint64_t fileSize, const Pcr& first, std::uint64_t time)
+  {
+    Bracket bracket{first, fileSize};
+
+    // Narrow down until a single probe covers the rest
+    while (bracket.after - bracket.before.offset > probeSize)
+    {
+      std::uint64_t middle = bracket.before.offset + (bracket.after - bracket.before.offset) / 2;
+      Pcr pcr;
+
+      if (!probe.find(file, middle, bracket.after, pcr))
+        bracket.after = middle;
+      else if (pcr.time <= time)
+        bracket.before = pcr;
+      else
+        bracket.after = pcr.offset;
+    }
+
+    // Then step from PCR to PCR
+    bracket.after = fileSize;
+    for (Pcr pcr; probe.find(file, bracket.before.offset + bracket.before.packetSize, fileSize, pcr);)
+    {
+      if (pcr.time > time)
+      {
+        bracket.after = pcr.offset;
+        break;
+      }
+      bracket.before = pcr;
+    }
+
+    return bracket;
+  }
+
+  struct FileHandle
+  {
+    int fd;
+    explicit FileHandle(const std::string& fileName) : fd(open(fileName.c_str(), O_RDONLY | O_CLOEXEC)) {}
+    ~FileHandle() { if (fd >= 0) close(fd); }
+  };
+}
+
+/******************************************************************************/
+
+bool parseTimeRange(const std::string& text, TimeRange& range)
+{
+  std::size_t dash = text.find('-');
+  return dash != std::string::npos &&
+         parseTime(text.substr(0, dash), range.from) &&
+         parseTime(text.substr(dash + 1), range.to) &&
+         range.from < range.to;
+}
+
+bool locateTimeRange(InputFiles& inputs, const TimeRange& range, const SeamOptions& seamOptions,
+                     std::vector<MatchResult>& searchResults, std::vector<Extent>& extents)
+{
+  const std::size_t count = inputs.size();
+  PcrProbe probe;
+
+  // Where every file begins in time
+  std::vector<Pcr> firsts(count);
+  for (std::size_t i = 0; i < count; ++i)
+  {
+    FileHandle file(inputs.name(i));
+    if (!probe.find(file.fd, 0, inputs.fileSize(i), firsts[i]))
+    {
+      std::cerr << "File: " << inputs.name(i) << " contains no PCR near its beginning." << '\n';
+      return false;
+    }
+  }
+
+  // The last files beginning in front of either end
+  std::size_t first = 0, last = 0;
+  for (std::size_t i = 1; i < count; ++i)
+  {
+    if (firsts[i].time <= range.from)
+      first = i;
+    if (firsts[i].time < range.to)
+      last = i;
+  }
+  last = std::max(first, last);
+
+  Bracket from, to;
+  {
+    FileHandle file(inputs.name(first));
+    from = bisect(probe, file.fd, inputs.fileSize(first), firsts[first], range.from);
+  }
+  {
+    FileHandle file(inputs.name(last));
+    to = bisect(probe, file.fd, inputs.fileSize(last), firsts[last], range.to);
+  }
+
+  if (first + 1 == count && from.after == inputs.fileSize(first))
+  {
+    std::cerr << "The time range begins behind the end of the recording." << '\n';
+    return false;
+  }
+
+  // Only the seams within the clip matter
+  bool known = searchResults.size() + 1 == count;
+  searchResults.resize(count - 1);
+
+  for (std::size_t i = first + 1; !known && i <= last; ++i)
+  {
+    std::istream& file1 = inputs.open(i-1);
+    std::istream& file2 = inputs.open(i);
+
+    if (!file1 || !file2)
+    {
+      std::cerr << "File: " << inputs.name(file1 ? i : i-1) << " failed to open." << '\n';
+      return false;
+    }
+
+    searchResults[i-1] = analyzeSeam(file1, file2, inputs.name(i), seamOptions);
+
+    if (seamOptions.verbose)
+      std::cout << "---------\n";
+  }
+
+  // Cut the clip out of the extents of these files; the end may lie in the
+  // overlap in front of the last file, which equals the predecessor's tail
+  std::vector<std::uint64_t> sizes(inputs.sizes().begin() + first, inputs.sizes().begin() + last + 1);
+  std::vector<MatchResult> seams(searchResults.begin() + first, searchResults.begin() + last);
+  std::vector<Extent> files = planExtents(sizes, seams);
+
+  std::int64_t begin = from.before.offset;
+  std::int64_t end = static_cast<std::int64_t>(files.back().outputOffset + to.after) -
+                     static_cast<std::int64_t>(files.back().sourceOffset);
+
+  extents.clear();
+  for (const auto& extent : files)
+  {
+    std::int64_t start = std::max<std::int64_t>(begin, extent.outputOffset);
+    std::int64_t stop = std::min<std::int64_t>(end, extent.outputOffset + extent.length);
+
+    if (start < stop)
+      extents.push_back(Extent{first + extent.file, extent.sourceOffset + (start - extent.outputOffset),
+                               static_cast<std::uint64_t>(start - begin),
+                               static_cast<std::uint64_t>(stop - start)});
+  }
+
+  if (extents.empty())
+  {
+    std::cerr << "The time range is not within the recording." << '\n';
+    return false;
+  }
+
+  return true;
+}
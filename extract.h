@@ -0,0 +1,38 @@
+#ifndef EXTRACT_H
+#define EXTRACT_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "binmerge.h"
+#include "inputs.h"
+
+/******************************************************************************/
+
+// Interval of a transport stream recording in 27 MHz ticks, counted from the
+// first PCR of its first file
+struct TimeRange
+{
+  std::uint64_t from = 0;
+  std::uint64_t to = 0;
+};
+
+// Parses "FROM-TO" with times given as [[HH:]MM:]SS[.fraction]
+bool parseTimeRange(const std::string& text, TimeRange& range);
+
+// Finds the part of the merged recording that covers the time range, without
+// merging or even reading all of it. The first PCR of every file tells which
+// files the range touches; within the first and the last of them, the range
+// is narrowed down by bisection, reading a few KiB at every probe until the
+// consecutive PCRs around each end are found. Only the seams between these
+// files are analyzed and stored in searchResults, unless it already holds
+// all seams (e.g. from a plan), so the cost is proportional to the clip
+// rather than to the recording. The extents start at the PCR packet in front
+// of the range and end with the packet in front of the first PCR behind it.
+// The PCRs have to increase steadily (no discontinuities). Returns false if
+// the range is not within the recording.
+bool locateTimeRange(InputFiles& inputs, const TimeRange& range, const SeamOptions& seamOptions,
+                     std::vector<MatchResult>& searchResults, std::vector<Extent>& extents);
+
+#endif // EXTRACT_H
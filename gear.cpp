@@ -0,0 +1,25 @@
+#include "gear.h"
+
+/******************************************************************************/
+
+namespace
+{
+  std::array<std::uint64_t, 256> makeGearTable()
+  {
+    std::array<std::uint64_t, 256> table;
+    std::uint64_t state = 0x9E3779B97F4A7C15ull;
+
+    // splitmix64
+    for (auto& value : table)
+    {
+      std::uint64_t z = (state += 0x9E3779B97F4A7C15ull);
+      z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+      z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+      value = z ^ (z >> 31);
+    }
+
+    return table;
+  }
+}
+
+const std::array<std::uint64_t, 256> gearTable = makeGearTable();
@@ -0,0 +1,22 @@
+#ifndef GEAR_H
+#define GEAR_H
+
+#include <array>
+#include <cstdint>
+
+/******************************************************************************/
+
+// Gear hash: every byte is shifted out after 64 more bytes, so the hash only
+// depends on the last 64 bytes (the window). Windows whose hash has its top
+// bits clear serve as content-defined anchors; their density is chosen by
+// the number of bits checked.
+constexpr std::uint64_t gearWindow = 64;
+
+extern const std::array<std::uint64_t, 256> gearTable;
+
+inline std::uint64_t gearUpdate(std::uint64_t hash, unsigned char byte)
+{
+  return (hash << 1) + gearTable[byte];
+}
+
+#endif // GEAR_H
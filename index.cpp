@@ -0,0 +1,131 @@
+#include "index.h"
+
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+
+#include "inputs.h"
+#include "ts.h"
+
+/******************************************************************************/
+
+// Picks PCRs of the first PCR carrying PID at least once per second and
+// right after every seam or discontinuity
+class IndexSink::PcrCollector : public TsParser
+{
+public:
+  struct Entry
+  {
+    std::uint16_t pid;
+    std::uint64_t pcr;
+    std::uint64_t offset;
+  };
+
+  std::vector<Entry> entries;
+  bool forceEntry = true;
+
+protected:
+  void packet(const unsigned char* packet, std::uint64_t offset) override
+  {
+    std::uint64_t pcr;
+    if (!readPcr(packet, pcr))
+      return;
+
+    std::uint16_t pid = packetPid(packet);
+    if (entries.empty())
+      pcrPid = pid;
+    else if (pid != pcrPid)
+      return;
+
+    // Jumps backwards or by more than a minute are discontinuities
+    std::uint64_t distance = entries.empty() ? 0 : pcrDistance(entries.back().pcr, pcr);
+    bool discontinuity = distance > 60 * pcrTicksPerSecond;
+
+    if (forceEntry || discontinuity || distance >= pcrTicksPerSecond)
+    {
+      entries.push_back(Entry{pid, pcr, offset});
+      forceEntry = false;
+    }
+  }
+
+private:
+  std::uint16_t pcrPid = 0;
+};
+
+/******************************************************************************/
+
+IndexSink::IndexSink(const std::vector<std::string>& outputFileNames, bool transportStream)
+  : outputFileNames(outputFileNames)
+{
+  if (transportStream)
+    pcrs.reset(new PcrCollector);
+}
+
+IndexSink::~IndexSink() = default;
+
+void IndexSink::beginMerge(const InputFiles& inputs, const std::vector<MatchResult>& searchResults)
+{
+  this->inputs = &inputs;
+  this->searchResults = &searchResults;
+}
+
+void IndexSink::beginFile(std::size_t, std::uint64_t outputOffset)
+{
+  segmentOffsets.push_back(outputOffset);
+
+  if (pcrs)
+    pcrs->forceEntry = true;
+}
+
+void IndexSink::write(const unsigned char* data, std::size_t size)
+{
+  outputSize += size;
+
+  if (pcrs)
+    pcrs->parse(data, size);
+}
+
+bool IndexSink::finish()
+{
+  bool written = true;
+  for (const auto& outputFileName : outputFileNames)
+    written = writeIndex(outputFileName) && written;
+
+  return written;
+}
+
+bool IndexSink::writeIndex(const std::string& outputFileName) const
+{
+  auto indexFileName = outputFileName + ".idx";
+  std::ofstream index(indexFileName);
+
+  index << "binmerge-index 1\n"
+        << "output " << outputSize << ' ' << getFilename(outputFileName) << '\n';
+
+  for (std::size_t i = 0; i < segmentOffsets.size(); ++i)
+  {
+    const auto& seams = *searchResults;
+    std::uint64_t sourceOffset = i > 0 && seams[i-1].patternFound ? seams[i-1].overlapCount() : 0;
+    std::uint64_t end = i + 1 < segmentOffsets.size() ? segmentOffsets[i+1] : outputSize;
+
+    index << "segment " << i << ' ' << segmentOffsets[i] << ' ' << sourceOffset << ' '
+          << end - segmentOffsets[i] << ' ' << inputs->name(i) << '\n';
+  }
+
+  for (std::size_t i = 1; i < segmentOffsets.size(); ++i)
+  {
+    const auto& result = (*searchResults)[i-1];
+    index << "seam " << i << ' ' << segmentOffsets[i] << ' '
+          << (result.patternFound ? result.overlapCount() : 0) << ' '
+          << std::fixed << std::setprecision(4) << result.quota() << '\n';
+  }
+
+  if (pcrs)
+    for (const auto& entry : pcrs->entries)
+      index << "pcr " << entry.pid << ' ' << entry.pcr << ' ' << entry.offset << '\n';
+
+  if (!index)
+    std::cerr << "File: " << indexFileName << " failed to open." << '\n';
+
+  return static_cast<bool>(index);
+}
@@ -0,0 +1,48 @@
+#ifndef INDEX_H
+#define INDEX_H
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "binmerge.h"
+
+/******************************************************************************/
+
+// Writes an index of the merged output to "<output>.idx" (for every output)
+// so that downstream tools do not have to scan the output themselves. It
+// contains the output position of every segment and seam and, for transport
+// streams, a sparse table mapping PCR values (27 MHz ticks) to output offsets:
+//
+//   binmerge-index 1
+//   output <size> <name>
+//   segment <index> <output offset> <source offset> <length> <file name>
+//   seam <index> <output offset> <overlap bytes> <quota>
+//   pcr <pid> <pcr> <output offset>
+class IndexSink : public MergeSink
+{
+public:
+  IndexSink(const std::vector<std::string>& outputFileNames, bool transportStream);
+  ~IndexSink();
+
+  void beginMerge(const InputFiles& inputs, const std::vector<MatchResult>& searchResults) override;
+  void beginFile(std::size_t i, std::uint64_t outputOffset) override;
+  void write(const unsigned char* data, std::size_t size) override;
+  bool finish() override;
+
+private:
+  class PcrCollector;
+
+  bool writeIndex(const std::string& outputFileName) const;
+
+  // Valid during the merge; the seams may still be corrected while merging
+  const InputFiles* inputs = nullptr;
+  const std::vector<MatchResult>* searchResults = nullptr;
+  std::vector<std::string> outputFileNames;
+
+  std::vector<std::uint64_t> segmentOffsets;
+  std::uint64_t outputSize = 0;
+  std::unique_ptr<PcrCollector> pcrs;
+};
+
+#endif // INDEX_H
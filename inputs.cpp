@@ -0,0 +1,357 @@
+#include "inputs.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <fstream>
+#include <streambuf>
+#include <thread>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <glob.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/******************************************************************************/
+
+bool naturalLess(const std::string& a, const std::string& b)
+{
+  std::size_t i = 0, j = 0;
+
+  while (i < a.size() && j < b.size())
+  {
+    if (std::isdigit(static_cast<unsigned char>(a[i])) &&
+        std::isdigit(static_cast<unsigned char>(b[j])))
+    {
+      // Compare whole numbers: skip leading zeros, then longer means larger
+      while (i < a.size() && a[i] == '0') ++i;
+      while (j < b.size() && b[j] == '0') ++j;
+
+      std::size_t endA = i, endB = j;
+      while (endA < a.size() && std::isdigit(static_cast<unsigned char>(a[endA]))) ++endA;
+      while (endB < b.size() && std::isdigit(static_cast<unsigned char>(b[endB]))) ++endB;
+
+      if (endA - i != endB - j)
+        return endA - i < endB - j;
+
+      int order = a.compare(i, endA - i, b, j, endB - j);
+      if (order != 0)
+        return order < 0;
+
+      i = endA;
+      j = endB;
+    }
+    else
+    {
+      if (a[i] != b[j])
+        return a[i] < b[j];
+
+      ++i;
+      ++j;
+    }
+  }
+
+  return a.size() - i < b.size() - j;
+}
+
+/******************************************************************************/
+
+namespace
+{
+  bool isDirectory(const std::string& path)
+  {
+    struct stat info;
+    return stat(path.c_str(), &info) == 0 && S_ISDIR(info.st_mode);
+  }
+
+  bool exists(const std::string& path)
+  {
+    struct stat info;
+    return stat(path.c_str(), &info) == 0;
+  }
+
+  std::vector<std::string> listDirectory(const std::string& path)
+  {
+    std::vector<std::string> entries;
+
+    DIR* directory = opendir(path.c_str());
+    if (!directory)
+      return entries;
+
+    while (dirent* entry = readdir(directory))
+    {
+      if (entry->d_name[0] == '.')
+        continue;
+
+      // Only take regular files, the type is missing on some filesystems
+      std::string name = path + '/' + entry->d_name;
+      if (entry->d_type == DT_REG || (entry->d_type == DT_UNKNOWN && !isDirectory(name)))
+        entries.push_back(name);
+    }
+
+    closedir(directory);
+    return entries;
+  }
+
+  std::vector<std::string> expandPattern(const std::string& pattern)
+  {
+    std::vector<std::string> matches;
+
+    glob_t result;
+    if (glob(pattern.c_str(), GLOB_NOSORT, nullptr, &result) == 0)
+      matches.assign(result.gl_pathv, result.gl_pathv + result.gl_pathc);
+
+    globfree(&result);
+    return matches;
+  }
+}
+
+std::vector<std::string> expandInputs(const std::vector<std::string>& arguments)
+{
+  std::vector<std::string> fileNames;
+
+  for (const auto& argument : arguments)
+  {
+    std::vector<std::string> expanded;
+
+    if (isDirectory(argument))
+      expanded = listDirectory(argument);
+    else if (!exists(argument) && argument.find_first_of("*?[") != std::string::npos)
+      expanded = expandPattern(argument);
+    else
+    {
+      // Plain files keep the order given by the user
+      fileNames.push_back(argument);
+      continue;
+    }
+
+    std::sort(expanded.begin(), expanded.end(), naturalLess);
+    fileNames.insert(fileNames.end(), expanded.begin(), expanded.end());
+  }
+
+  return fileNames;
+}
+
+/******************************************************************************/
+
+namespace
+{
+  // Read-only, seekable stream buffer on top of a memory block
+  class MemoryBuffer : public std::streambuf
+  {
+  public:
+    void assign(char* data, std::size_t size)
+    {
+      setg(data, data, data + size);
+    }
+
+  protected:
+    pos_type seekoff(off_type offset, std::ios_base::seekdir direction,
+                     std::ios_base::openmode) override
+    {
+      char* base = direction == std::ios_base::beg ? eback() :
+                   direction == std::ios_base::cur ? gptr() : egptr();
+
+      if (base + offset < eback() || base + offset > egptr())
+        return pos_type(off_type(-1));
+
+      setg(eback(), base + offset, egptr());
+      return pos_type(gptr() - eback());
+    }
+
+    pos_type seekpos(pos_type position, std::ios_base::openmode mode) override
+    {
+      return seekoff(off_type(position), std::ios_base::beg, mode);
+    }
+  };
+}
+
+struct InputFiles::Stream
+{
+  // Either a regular file stream, a memory copy of a tiny file or a decompressor
+  std::ifstream file;
+  std::vector<char> data;
+  MemoryBuffer memory;
+  std::unique_ptr<DecompressedBuffer> decompressed;
+  std::istream stream{nullptr};
+};
+
+InputFiles::InputFiles(std::vector<std::string> fileNames, std::size_t maxOpen, std::size_t tinySize)
+  : fileNames(std::move(fileNames)), maxOpen(std::max<std::size_t>(maxOpen, 2)), tinySize(tinySize)
+{
+  // Gather all sizes in a single pass instead of seeking to each file's end later
+  fileSizes.reserve(this->fileNames.size());
+  fileTimes.reserve(this->fileNames.size());
+
+  for (const auto& name : this->fileNames)
+  {
+#ifdef STATX_SIZE
+    struct statx info;
+    bool ok = statx(AT_FDCWD, name.c_str(), AT_STATX_DONT_SYNC, STATX_SIZE | STATX_MTIME, &info) == 0;
+    fileSizes.push_back(ok ? info.stx_size : 0);
+    fileTimes.push_back(ok ? info.stx_mtime.tv_sec : 0);
+#else
+    struct stat info;
+    bool ok = stat(name.c_str(), &info) == 0;
+    fileSizes.push_back(ok ? info.st_size : 0);
+    fileTimes.push_back(ok ? info.st_mtime : 0);
+#endif
+
+    compressions.push_back(compressionOf(name));
+  }
+
+  // Compressed files usually have to be decompressed entirely to learn their
+  // size, which is done for several files at once
+  std::vector<std::size_t> compressed;
+  for (std::size_t i = 0; i < compressions.size(); ++i)
+    if (compressions[i] != Compression::none && compressionSupported(compressions[i]) && fileSizes[i] > 0)
+      compressed.push_back(i);
+
+  corruptFiles.assign(compressions.size(), false);
+
+  std::atomic<std::size_t> next(0);
+  auto worker = [&]
+  {
+    for (std::size_t k; (k = next++) < compressed.size();)
+    {
+      std::size_t i = compressed[k];
+      bool corrupt;
+      if (!decompressedSize(this->fileNames[i], compressions[i], fileSizes[i], corrupt))
+        fileSizes[i] = 0;
+      corruptFiles[i] = corrupt;
+    }
+  };
+
+  std::vector<std::thread> workers;
+  std::size_t threads = std::min<std::size_t>(compressed.size(), std::thread::hardware_concurrency());
+  for (std::size_t t = 1; t < threads; ++t)
+    workers.emplace_back(worker);
+
+  worker();
+
+  for (auto& thread : workers)
+    thread.join();
+}
+
+bool InputFiles::anyCompressed() const
+{
+  return std::any_of(compressions.begin(), compressions.end(),
+                     [](Compression compression) { return compression != Compression::none; });
+}
+
+bool InputFiles::corrupt(std::size_t i) const
+{
+  auto cached = streams.find(i);
+  return corruptFiles[i] ||
+         (cached != streams.end() && cached->second->decompressed && cached->second->decompressed->corrupt());
+}
+
+std::uint64_t InputFiles::cachedBytes(std::size_t i, std::uint64_t offset, std::uint64_t length) const
+{
+  // Mapped in windows, so that the residency vector stays small
+  constexpr std::uint64_t window = 1 << 30;
+
+  if (compressions[i] != Compression::none || offset >= fileSizes[i])
+    return 0;
+
+  int fd = ::open(fileNames[i].c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    return 0;
+
+  const std::uint64_t pageSize = sysconf(_SC_PAGESIZE);
+  const std::uint64_t end = std::min(fileSizes[i], offset + length);
+  std::vector<unsigned char> pages(window / pageSize);
+  std::uint64_t cached = 0;
+
+  for (std::uint64_t start = offset / pageSize * pageSize; start < end; start += window)
+  {
+    std::uint64_t mapped = std::min(window, end - start);
+    void* map = mmap(nullptr, mapped, PROT_READ, MAP_SHARED, fd, start);
+    if (map == MAP_FAILED)
+      break;
+
+    if (mincore(map, mapped, &pages[0]) == 0)
+    {
+      for (std::uint64_t p = 0; p * pageSize < mapped; ++p)
+      {
+        // Only the part of the page within the range counts
+        std::uint64_t first = std::max(offset, start + p * pageSize);
+        std::uint64_t last = std::min(end, start + (p + 1) * pageSize);
+        if ((pages[p] & 1) && last > first)
+          cached += last - first;
+      }
+    }
+
+    munmap(map, mapped);
+  }
+
+  close(fd);
+  return cached;
+}
+
+InputFiles::~InputFiles() = default;
+
+std::istream& InputFiles::open(std::size_t i)
+{
+  auto cached = streams.find(i);
+  if (cached != streams.end())
+  {
+    recentlyUsed.remove(i);
+    recentlyUsed.push_front(i);
+
+    // Reset any state left behind by the previous user
+    cached->second->stream.clear();
+    return cached->second->stream;
+  }
+
+  // Make room by closing the least recently used stream
+  if (streams.size() >= maxOpen)
+  {
+    corruptFiles[recentlyUsed.back()] = corrupt(recentlyUsed.back());
+    streams.erase(recentlyUsed.back());
+    recentlyUsed.pop_back();
+  }
+
+  std::unique_ptr<Stream> entry(new Stream);
+
+  if (compressions[i] != Compression::none)
+  {
+    entry->decompressed = openDecompressed(fileNames[i], compressions[i], fileSizes[i]);
+    entry->stream.rdbuf(entry->decompressed.get());
+
+    if (!entry->decompressed)
+      entry->stream.setstate(std::ios::failbit);
+  }
+  else if (fileSizes[i] > 0 && fileSizes[i] <= tinySize)
+  {
+    int fd = ::open(fileNames[i].c_str(), O_RDONLY | O_CLOEXEC);
+    entry->data.resize(fileSizes[i]);
+
+    ssize_t bytesRead = fd < 0 ? -1 : read(fd, entry->data.data(), entry->data.size());
+    if (fd >= 0)
+      close(fd);
+
+    entry->data.resize(bytesRead < 0 ? 0 : bytesRead);
+    entry->memory.assign(entry->data.data(), entry->data.size());
+    entry->stream.rdbuf(&entry->memory);
+
+    if (bytesRead < 0)
+      entry->stream.setstate(std::ios::failbit);
+  }
+  else
+  {
+    entry->file.open(fileNames[i], std::ios::binary);
+    entry->stream.rdbuf(entry->file.rdbuf());
+
+    if (!entry->file)
+      entry->stream.setstate(std::ios::failbit);
+  }
+
+  auto& stream = entry->stream;
+  streams[i] = std::move(entry);
+  recentlyUsed.push_front(i);
+
+  return stream;
+}
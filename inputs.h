@@ -0,0 +1,81 @@
+#ifndef INPUTS_H
+#define INPUTS_H
+
+#include <cstdint>
+#include <istream>
+#include <list>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "compressed.h"
+
+/******************************************************************************/
+
+// Compares strings such that embedded numbers are ordered by value ("seg2" < "seg10")
+bool naturalLess(const std::string& a, const std::string& b);
+
+// Replaces directories and glob patterns by the (naturally sorted) files they contain
+std::vector<std::string> expandInputs(const std::vector<std::string>& arguments);
+
+/******************************************************************************/
+
+// Set of input files with a bounded number of simultaneously open streams.
+// All files are stat'ed once up front; files up to tinySize bytes are read
+// with a single system call and served from memory. Compressed files (see
+// compressed.h) are decompressed on the fly, their sizes are those of the
+// decompressed data.
+class InputFiles
+{
+public:
+  static constexpr std::size_t defaultMaxOpen = 64;
+  static constexpr std::size_t defaultTinySize = 64 * 1024;
+
+  explicit InputFiles(std::vector<std::string> fileNames,
+                      std::size_t maxOpen = defaultMaxOpen,
+                      std::size_t tinySize = defaultTinySize);
+  ~InputFiles();
+
+  std::size_t size() const { return fileNames.size(); }
+  const std::vector<std::string>& names() const { return fileNames; }
+  const std::string& name(std::size_t i) const { return fileNames[i]; }
+
+  // Size and modification time as determined up front (0 if the file could not be stat'ed)
+  std::uint64_t fileSize(std::size_t i) const { return fileSizes[i]; }
+  const std::vector<std::uint64_t>& sizes() const { return fileSizes; }
+  std::int64_t modificationTime(std::size_t i) const { return fileTimes[i]; }
+  const std::vector<std::int64_t>& modificationTimes() const { return fileTimes; }
+
+  Compression compression(std::size_t i) const { return compressions[i]; }
+  bool anyCompressed() const;
+
+  // Whether decompressing the file has failed so far, either while
+  // determining its size or while reading it (where the data just ends)
+  bool corrupt(std::size_t i) const;
+
+  // Number of bytes of the given range of a file that are in the page cache
+  // (checked with mincore() on a temporary mapping, nothing is read). Always
+  // 0 for compressed files, whose offsets do not refer to the file on disk.
+  std::uint64_t cachedBytes(std::size_t i, std::uint64_t offset, std::uint64_t length) const;
+
+  // Returns a stream for the given file, which stays valid until maxOpen other
+  // files have been opened; the stream's failbit is set if opening failed
+  std::istream& open(std::size_t i);
+
+private:
+  struct Stream;
+
+  std::vector<std::string> fileNames;
+  std::vector<std::uint64_t> fileSizes;
+  std::vector<std::int64_t> fileTimes;
+  std::vector<Compression> compressions;
+  std::vector<char> corruptFiles; // not vector<bool>, set concurrently
+  std::size_t maxOpen, tinySize;
+
+  // Open streams in least recently used order (front is the most recent one)
+  std::list<std::size_t> recentlyUsed;
+  std::unordered_map<std::size_t, std::unique_ptr<Stream>> streams;
+};
+
+#endif // INPUTS_H
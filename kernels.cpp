@@ -0,0 +1,321 @@
+#include "kernels.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <type_traits>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/******************************************************************************/
+
+namespace
+{
+  // Unsigned integer of K bytes
+  template <std::size_t K> struct Word;
+  template <> struct Word<1> { using type = std::uint8_t; };
+  template <> struct Word<2> { using type = std::uint16_t; };
+  template <> struct Word<4> { using type = std::uint32_t; };
+  template <> struct Word<8> { using type = std::uint64_t; };
+
+  template <std::size_t K>
+  inline std::uint64_t load(const unsigned char* data)
+  {
+    typename Word<K>::type word;
+    std::memcpy(&word, data, K);
+    return word;
+  }
+
+  // Compares N bytes with as few word loads as possible. The recursion is
+  // resolved at compile time; the result is nonzero if any byte differs.
+  template <std::size_t N>
+  struct FixedCompare
+  {
+    static constexpr std::size_t chunk = N >= 8 ? 8 : N >= 4 ? 4 : N >= 2 ? 2 : 1;
+
+    static std::uint64_t differs(const unsigned char* a, const unsigned char* b)
+    {
+      return (load<chunk>(a) ^ load<chunk>(b)) | FixedCompare<N - chunk>::differs(a + chunk, b + chunk);
+    }
+  };
+
+  template <>
+  struct FixedCompare<0>
+  {
+    static std::uint64_t differs(const unsigned char*, const unsigned char*) { return 0; }
+  };
+
+  // Pattern of a fixed size at every position: candidates are found by the
+  // first byte (memchr is vectorized), then compared in full
+  template <std::size_t N, std::size_t Stride>
+  struct Search
+  {
+    static const unsigned char* run(const unsigned char* begin, const unsigned char* end,
+                                    const unsigned char* pattern, std::size_t, std::size_t)
+    {
+      if (end - begin < static_cast<std::ptrdiff_t>(N))
+        return nullptr;
+
+      const unsigned char* last = end - N;
+
+      for (const unsigned char* p = begin; p <= last; ++p)
+      {
+        p = static_cast<const unsigned char*>(std::memchr(p, pattern[0], last - p + 1));
+        if (!p)
+          return nullptr;
+
+        if (FixedCompare<N>::differs(p, pattern) == 0)
+          return p;
+      }
+
+      return nullptr;
+    }
+  };
+
+  // Pattern of a fixed size at one position per packet
+  template <std::size_t N, std::size_t Stride>
+  struct StridedSearch
+  {
+    static const unsigned char* run(const unsigned char* begin, const unsigned char* end,
+                                    const unsigned char* pattern, std::size_t, std::size_t first)
+    {
+      if (end - begin < static_cast<std::ptrdiff_t>(first + N))
+        return nullptr;
+
+      const unsigned char* last = end - N;
+
+      for (const unsigned char* p = begin + first; p <= last; p += Stride)
+        if (FixedCompare<N>::differs(p, pattern) == 0)
+          return p;
+
+      return nullptr;
+    }
+  };
+
+  // Any pattern size
+  template <std::size_t Stride>
+  struct GenericSearch
+  {
+    static const unsigned char* run(const unsigned char* begin, const unsigned char* end,
+                                    const unsigned char* pattern, std::size_t patternSize, std::size_t first)
+    {
+      if (Stride == 1)
+      {
+        auto result = std::search(begin, end, pattern, pattern + patternSize);
+        return result != end || patternSize == 0 ? result : nullptr;
+      }
+
+      if (end - begin < static_cast<std::ptrdiff_t>(first + patternSize))
+        return nullptr;
+
+      for (const unsigned char* p = begin + first; p + patternSize <= end; p += Stride)
+        if (std::memcmp(p, pattern, patternSize) == 0)
+          return p;
+
+      return nullptr;
+    }
+  };
+
+  template <std::size_t N, std::size_t Stride>
+  using Kernel = typename std::conditional<Stride == 1, Search<N, Stride>, StridedSearch<N, Stride>>::type;
+
+  constexpr std::size_t patternSizes[] = {16, 20, 32, 64};
+  constexpr std::size_t strides[] = {1, 188, 192, 204};
+
+  // Rows: pattern sizes as above plus generic, columns: strides as above
+  const SearchKernel searchKernels[5][4] =
+  {
+    {Kernel<16, 1>::run, Kernel<16, 188>::run, Kernel<16, 192>::run, Kernel<16, 204>::run},
+    {Kernel<20, 1>::run, Kernel<20, 188>::run, Kernel<20, 192>::run, Kernel<20, 204>::run},
+    {Kernel<32, 1>::run, Kernel<32, 188>::run, Kernel<32, 192>::run, Kernel<32, 204>::run},
+    {Kernel<64, 1>::run, Kernel<64, 188>::run, Kernel<64, 192>::run, Kernel<64, 204>::run},
+    {GenericSearch<1>::run, GenericSearch<188>::run, GenericSearch<192>::run, GenericSearch<204>::run},
+  };
+
+  // Number of nonzero bytes in a word
+  inline std::size_t nonzeroBytes(std::uint64_t x)
+  {
+    x |= x >> 4;
+    x |= x >> 2;
+    x |= x >> 1;
+    return __builtin_popcountll(x & 0x0101010101010101ull);
+  }
+
+  // Counts the differing bytes of Words 8 byte words
+  template <std::size_t Words>
+  struct BlockDifferences
+  {
+    static std::size_t count(const unsigned char* a, const unsigned char* b)
+    {
+      return nonzeroBytes(load<8>(a) ^ load<8>(b)) + BlockDifferences<Words - 1>::count(a + 8, b + 8);
+    }
+  };
+
+  template <>
+  struct BlockDifferences<0>
+  {
+    static std::size_t count(const unsigned char*, const unsigned char*) { return 0; }
+  };
+
+  // Whether the pattern starts at bit shift of the byte at p
+  inline bool matchesBits(const unsigned char* p, const unsigned char* end,
+                          const BitPattern& pattern, unsigned shift)
+  {
+    const auto& bytes = pattern.bytes[shift];
+    const auto& masks = pattern.masks[shift];
+    std::size_t size = bytes.size();
+
+    return static_cast<std::size_t>(end - p) >= size &&
+           ((p[0] ^ bytes[0]) & masks[0]) == 0 &&
+           ((p[size-1] ^ bytes[size-1]) & masks[size-1]) == 0 &&
+           (size < 3 || std::memcmp(p + 1, &bytes[1], size - 2) == 0);
+  }
+
+  // First shift at which the pattern starts in the byte at p, 8 if none
+  inline unsigned matchingShift(const unsigned char* p, const unsigned char* end,
+                                const BitPattern& pattern, unsigned firstShift)
+  {
+    for (unsigned shift = firstShift; shift < 8; ++shift)
+      if (matchesBits(p, end, pattern, shift))
+        return shift;
+    return 8;
+  }
+}
+
+/******************************************************************************/
+
+SearchKernel selectSearchKernel(std::size_t patternSize, std::size_t stride)
+{
+  std::size_t row = std::find(std::begin(patternSizes), std::end(patternSizes), patternSize) - std::begin(patternSizes);
+  std::size_t column = std::find(std::begin(strides), std::end(strides), stride) - std::begin(strides);
+
+  // Strides other than the packet sizes are not used
+  if (column == 4)
+    column = 0;
+
+  return searchKernels[row][column];
+}
+
+std::size_t countDifferences(const unsigned char* a, const unsigned char* b, std::size_t size)
+{
+  constexpr std::size_t blockSize = 64;
+  std::size_t differences = 0, i = 0;
+
+  for (; i + blockSize <= size; i += blockSize)
+    differences += BlockDifferences<blockSize / 8>::count(a + i, b + i);
+
+  for (; i < size; ++i)
+    differences += a[i] != b[i];
+
+  return differences;
+}
+
+/******************************************************************************/
+
+BitPattern::BitPattern(const std::vector<unsigned char>& pattern)
+{
+  std::size_t size = pattern.size();
+
+  bytes[0] = pattern;
+  masks[0].assign(size, 0xFF);
+
+  for (unsigned shift = 1; shift < 8; ++shift)
+  {
+    bytes[shift].resize(size + 1);
+    masks[shift].assign(size + 1, 0xFF);
+
+    for (std::size_t k = 0; k <= size; ++k)
+    {
+      unsigned previous = k > 0 ? pattern[k-1] : 0;
+      unsigned current = k < size ? pattern[k] : 0;
+      bytes[shift][k] = static_cast<unsigned char>(previous << (8 - shift) | current >> shift);
+    }
+
+    masks[shift].front() = 0xFF >> shift;
+    masks[shift].back() = static_cast<unsigned char>(0xFF << (8 - shift));
+  }
+}
+
+const unsigned char* searchBits(const unsigned char* begin, const unsigned char* end,
+                                const BitPattern& pattern, unsigned firstShift, unsigned& shift)
+{
+  const std::size_t size = pattern.bytes[0].size();
+  if (size == 0 || end - begin < static_cast<std::ptrdiff_t>(size))
+    return nullptr;
+
+  const unsigned char* p = begin;
+
+  // The start of the range may only match at the later shifts
+  if (firstShift > 0)
+  {
+    shift = matchingShift(p, end, pattern, firstShift);
+    if (shift < 8)
+      return p;
+    ++p;
+  }
+
+  // Bytes 1 and 2 of every shifted pattern are whole bytes of the pattern
+  if (size >= 3)
+  {
+#ifdef __SSE2__
+    __m128i firstKeys[8], secondKeys[8];
+    for (unsigned s = 0; s < 8; ++s)
+    {
+      firstKeys[s] = _mm_set1_epi8(static_cast<char>(pattern.bytes[s][1]));
+      secondKeys[s] = _mm_set1_epi8(static_cast<char>(pattern.bytes[s][2]));
+    }
+
+    for (; p + 18 <= end; p += 16)
+    {
+      __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 1));
+      __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 2));
+      __m128i hits = _mm_setzero_si128();
+
+      for (unsigned s = 0; s < 8; ++s)
+        hits = _mm_or_si128(hits, _mm_and_si128(_mm_cmpeq_epi8(a, firstKeys[s]), _mm_cmpeq_epi8(b, secondKeys[s])));
+
+      for (unsigned mask = _mm_movemask_epi8(hits); mask != 0; mask &= mask - 1)
+      {
+        const unsigned char* candidate = p + __builtin_ctz(mask);
+        shift = matchingShift(candidate, end, pattern, 0);
+        if (shift < 8)
+          return candidate;
+      }
+    }
+#endif
+
+    unsigned char first[8], second[8];
+    for (unsigned s = 0; s < 8; ++s)
+    {
+      first[s] = pattern.bytes[s][1];
+      second[s] = pattern.bytes[s][2];
+    }
+
+    for (; p + 3 <= end; ++p)
+    {
+      for (unsigned s = 0; s < 8; ++s)
+      {
+        if (p[1] == first[s] && p[2] == second[s] && matchesBits(p, end, pattern, s))
+        {
+          shift = s;
+          return p;
+        }
+      }
+    }
+
+    return nullptr;
+  }
+
+  // Tiny patterns are compared at every position
+  for (; p < end; ++p)
+  {
+    shift = matchingShift(p, end, pattern, 0);
+    if (shift < 8)
+      return p;
+  }
+
+  return nullptr;
+}
@@ -0,0 +1,50 @@
+#ifndef KERNELS_H
+#define KERNELS_H
+
+#include <cstddef>
+#include <vector>
+
+/******************************************************************************/
+
+// Inner loops of the seam analysis, working on memory only. Search kernels
+// are instantiated for common pattern sizes (16, 20, 32 and 64 bytes) and
+// candidate strides (every byte, or one position per 188, 192 or 204 byte
+// packet), with the pattern comparison unrolled into a few word compares.
+
+// Returns the first occurrence of the pattern lying entirely within
+// [begin, end) and starting at begin + first + k * stride, nullptr if none
+using SearchKernel = const unsigned char* (*)(const unsigned char* begin,
+                                              const unsigned char* end,
+                                              const unsigned char* pattern,
+                                              std::size_t patternSize,
+                                              std::size_t first);
+
+// Picks the kernel for a search once, so that the search loop itself does
+// not branch on sizes. Uncommon sizes get generic kernels.
+SearchKernel selectSearchKernel(std::size_t patternSize, std::size_t stride);
+
+// Pattern placed at every bit offset within a byte (bits most significant
+// first), for data that is not aligned to the pattern's byte boundaries. At
+// shift s, the pattern's first bit is bit s of the first byte; the masks mark
+// the bits belonging to the pattern (first and last byte are partial).
+struct BitPattern
+{
+  std::vector<unsigned char> bytes[8];
+  std::vector<unsigned char> masks[8];
+
+  explicit BitPattern(const std::vector<unsigned char>& pattern);
+};
+
+// Returns the first occurrence of the pattern at any bit offset lying
+// entirely within [begin, end), at least firstShift bits behind begin, and
+// sets shift to the bit at which it starts within the returned byte. All 8
+// shifts are looked for at once: candidates are found by two whole bytes of
+// every shifted pattern (16 positions per step with SSE2), then compared in
+// full. Returns nullptr if there is none.
+const unsigned char* searchBits(const unsigned char* begin, const unsigned char* end,
+                                const BitPattern& pattern, unsigned firstShift, unsigned& shift);
+
+// Number of positions at which the two blocks differ
+std::size_t countDifferences(const unsigned char* a, const unsigned char* b, std::size_t size);
+
+#endif // KERNELS_H
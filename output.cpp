@@ -0,0 +1,560 @@
+#include "output.h"
+
+#include <atomic>
+#include <exception>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+#include "ts.h"
+
+#ifdef BINMERGE_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+/******************************************************************************/
+
+FileSink::FileSink(const std::string& fileName)
+  : fileName(fileName), file(fileName, std::ios::binary)
+{
+}
+
+void FileSink::write(const unsigned char* data, std::size_t size)
+{
+  file.write(reinterpret_cast<const char*>(data), size);
+}
+
+bool FileSink::finish()
+{
+  file.close();
+  if (!file)
+    std::cerr << "File: " << fileName << " could not be written." << '\n';
+
+  return static_cast<bool>(file);
+}
+
+/******************************************************************************/
+
+// Collects the stream offsets at which packets end
+class SplitFileSink::PacketBoundaries : public TsParser
+{
+public:
+  std::deque<std::uint64_t> ends;
+
+protected:
+  void packet(const unsigned char*, std::uint64_t offset) override
+  {
+    ends.push_back(offset + packetSize());
+  }
+};
+
+namespace
+{
+  // Without any packet boundary in sight, the part is cut at its nominal end
+  constexpr std::uint64_t maximumHeld = 1 << 20;
+}
+
+SplitFileSink::SplitFileSink(const std::string& fileName, std::uint64_t partSize, bool packetAligned)
+  : fileName(fileName), partSize(partSize)
+{
+  if (packetAligned)
+    boundaries.reset(new PacketBoundaries);
+
+  nextPart(0);
+}
+
+SplitFileSink::~SplitFileSink() = default;
+
+std::string SplitFileSink::partName(const std::string& fileName, std::size_t number)
+{
+  // The running number goes in front of the extension, if there is one
+  std::size_t dot = fileName.find_last_of('.');
+  std::size_t slash = fileName.find_last_of("/\\");
+  if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+    dot = fileName.size();
+
+  std::ostringstream name;
+  name << fileName.substr(0, dot) << '.' << std::setw(3) << std::setfill('0') << number
+       << fileName.substr(dot);
+  return name.str();
+}
+
+void SplitFileSink::write(const unsigned char* data, std::size_t size)
+{
+  if (boundaries)
+  {
+    held.insert(held.end(), data, data + size);
+    streamOffset += size;
+
+    boundaries->parse(data, size);
+    flushHeld(false);
+    return;
+  }
+
+  while (size > 0)
+  {
+    if (streamOffset == partEnd)
+      nextPart(streamOffset);
+
+    std::size_t bytes = std::min<std::uint64_t>(size, partEnd - streamOffset);
+    part.write(reinterpret_cast<const char*>(data), bytes);
+
+    streamOffset += bytes;
+    data += bytes;
+    size -= bytes;
+  }
+}
+
+bool SplitFileSink::finish()
+{
+  if (boundaries)
+    flushHeld(true);
+
+  if (part.is_open())
+  {
+    part.close();
+    if (!part)
+    {
+      std::cerr << "File: " << partName(fileName, partNumber) << " could not be written." << '\n';
+      failed = true;
+    }
+  }
+
+  std::cout << "Output split into " << partNumber << " part(s)" << '\n';
+  return !failed;
+}
+
+void SplitFileSink::flushHeld(bool final)
+{
+  auto& ends = boundaries->ends;
+
+  for (;;)
+  {
+    // Complete packets within the current part can go there right away
+    std::uint64_t end = heldOffset;
+    while (!ends.empty() && ends.front() <= partEnd)
+    {
+      end = ends.front();
+      ends.pop_front();
+    }
+    writeHeld(end);
+
+    if (streamOffset <= partEnd)
+    {
+      // Whatever follows the last packet belongs to the last part
+      if (final)
+        writeHeld(streamOffset);
+      return;
+    }
+
+    // Once the packet crossing the end of the part is known, the part ends
+    // before it. Parts too small for a single packet are cut anyway.
+    if (ends.empty() && !final && streamOffset - partEnd < maximumHeld)
+      return;
+
+    if (heldOffset == partStart)
+      writeHeld(partEnd);
+
+    nextPart(heldOffset);
+  }
+}
+
+void SplitFileSink::writeHeld(std::uint64_t end)
+{
+  std::size_t bytes = end - heldOffset;
+  if (bytes == 0)
+    return;
+
+  part.write(reinterpret_cast<const char*>(held.data()), bytes);
+  held.erase(held.begin(), held.begin() + bytes);
+  heldOffset = end;
+}
+
+void SplitFileSink::nextPart(std::uint64_t start)
+{
+  if (part.is_open())
+  {
+    part.close();
+    if (!part)
+    {
+      std::cerr << "File: " << partName(fileName, partNumber) << " could not be written." << '\n';
+      failed = true;
+    }
+  }
+
+  // Once a part is lost, the rest of the output is useless as well
+  auto name = partName(fileName, ++partNumber);
+  if (failed)
+    return;
+
+  part.open(name, std::ios::binary);
+  if (!part)
+  {
+    std::cerr << "File: " << name << " failed to open." << '\n';
+    failed = true;
+  }
+
+  partStart = start;
+  partEnd = start + partSize;
+}
+
+/******************************************************************************/
+
+AsyncSink::AsyncSink(std::unique_ptr<MergeSink> sink, std::size_t queueSize)
+  : sink(std::move(sink)), queueSize(queueSize), thread(&AsyncSink::run, this)
+{
+}
+
+AsyncSink::~AsyncSink()
+{
+  // Only reached without finish() if the merge was aborted
+  if (thread.joinable())
+    stop();
+}
+
+void AsyncSink::write(const unsigned char* data, std::size_t size)
+{
+  std::unique_lock<std::mutex> lock(mutex);
+
+  // Backpressure: wait until the writer has caught up far enough
+  changed.wait(lock, [&] { return queued == 0 || queued + size <= queueSize; });
+
+  std::vector<unsigned char> buffer;
+  if (!spare.empty())
+  {
+    buffer = std::move(spare.back());
+    spare.pop_back();
+  }
+  buffer.assign(data, data + size);
+
+  queue.push_back(std::move(buffer));
+  queued += size;
+  changed.notify_all();
+}
+
+bool AsyncSink::finish()
+{
+  stop();
+  return sink->finish() && !failed;
+}
+
+void AsyncSink::stop()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    finished = true;
+  }
+  changed.notify_all();
+
+  thread.join();
+}
+
+void AsyncSink::run()
+{
+  std::unique_lock<std::mutex> lock(mutex);
+
+  for (;;)
+  {
+    changed.wait(lock, [&] { return !queue.empty() || finished; });
+    if (queue.empty())
+      return;
+
+    auto buffer = std::move(queue.front());
+    queue.pop_front();
+
+    // An exception must not end the thread, the merge would wait forever
+    lock.unlock();
+    try
+    {
+      if (!failed)
+        sink->write(buffer.data(), buffer.size());
+    }
+    catch (const std::exception& error)
+    {
+      std::cerr << "Output: " << error.what() << '\n';
+      failed = true;
+    }
+    lock.lock();
+
+    queued -= buffer.size();
+    spare.push_back(std::move(buffer));
+    changed.notify_all();
+  }
+}
+
+/******************************************************************************/
+
+#ifdef BINMERGE_HAVE_ZSTD
+namespace
+{
+  // Writes the data in the seekable zstd format: independent frames of
+  // frameSize bytes each, followed by a seek table in a skippable frame.
+  // Frames are compressed on a pool of threads and written in order; the
+  // number of frames in flight is bounded, so that memory use is, too.
+  class ZstdSink : public MergeSink
+  {
+  public:
+    static constexpr std::size_t frameSize = 4 << 20;
+
+    ZstdSink(const std::string& fileName, int level, unsigned threads)
+      : fileName(fileName), file(fileName, std::ios::binary), level(level),
+        maxInFlight(2 * std::max(threads, 1u))
+    {
+      current.reset(new Frame);
+      current->input.reserve(frameSize);
+
+      for (unsigned t = 0; t < std::max(threads, 1u); ++t)
+        workers.emplace_back(&ZstdSink::compress, this);
+    }
+
+    ~ZstdSink()
+    {
+      stop();
+    }
+
+    bool isOpen() const { return static_cast<bool>(file); }
+
+    void write(const unsigned char* data, std::size_t size) override
+    {
+      while (size > 0)
+      {
+        std::size_t bytes = std::min(size, frameSize - current->input.size());
+        current->input.insert(current->input.end(), data, data + bytes);
+        data += bytes;
+        size -= bytes;
+
+        if (current->input.size() == frameSize)
+          submit();
+      }
+    }
+
+    bool finish() override
+    {
+      if (!current->input.empty())
+        submit();
+
+      writeFrames(0);
+      stop();
+
+      // Seek table: compressed and decompressed size of every frame
+      std::vector<unsigned char> table;
+      auto append = [&](std::uint32_t value)
+      {
+        for (int i = 0; i < 4; ++i)
+          table.push_back(static_cast<unsigned char>(value >> (8 * i)));
+      };
+
+      append(0x184D2A5E);
+      append(static_cast<std::uint32_t>(seekTable.size() * 8 + 9));
+      for (const auto& entry : seekTable)
+      {
+        append(entry.first);
+        append(entry.second);
+      }
+      append(static_cast<std::uint32_t>(seekTable.size()));
+      table.push_back(0);
+      append(0x8F92EAB1);
+
+      file.write(reinterpret_cast<const char*>(table.data()), table.size());
+      file.close();
+
+      if (!file || failed)
+      {
+        std::cerr << "File: " << fileName << " could not be written." << '\n';
+        return false;
+      }
+
+      return true;
+    }
+
+  private:
+    struct Frame
+    {
+      std::vector<char> input, output;
+      bool compressed = false;
+    };
+
+    // Hands the current frame to the workers and writes finished frames
+    void submit()
+    {
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        frames.push_back(std::move(current));
+      }
+      changed.notify_all();
+
+      current.reset(new Frame);
+      current->input.reserve(frameSize);
+
+      writeFrames(maxInFlight);
+    }
+
+    // Writes frames in order until at most the given number is left
+    void writeFrames(std::size_t keep)
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+
+      while (frames.size() > keep || (!frames.empty() && frames.front()->compressed))
+      {
+        changed.wait(lock, [&] { return frames.front()->compressed; });
+
+        std::unique_ptr<Frame> frame = std::move(frames.front());
+        frames.pop_front();
+        --compressing;
+
+        lock.unlock();
+        file.write(frame->output.data(), frame->output.size());
+        seekTable.emplace_back(frame->output.size(), frame->input.size());
+        lock.lock();
+      }
+    }
+
+    void compress()
+    {
+      ZSTD_CCtx* context = ZSTD_createCCtx();
+      std::unique_lock<std::mutex> lock(mutex);
+
+      for (;;)
+      {
+        // Frames before "compressing" are either done or taken by other workers
+        changed.wait(lock, [&] { return compressing < frames.size() || stopping; });
+        if (compressing >= frames.size())
+          break;
+
+        Frame& frame = *frames[compressing++];
+        lock.unlock();
+
+        frame.output.resize(ZSTD_compressBound(frame.input.size()));
+        std::size_t size = context ? ZSTD_compressCCtx(context, &frame.output[0], frame.output.size(),
+                                                       frame.input.data(), frame.input.size(), level) : 0;
+        if (!context || ZSTD_isError(size))
+        {
+          failed = true;
+          size = 0;
+        }
+        frame.output.resize(size);
+
+        lock.lock();
+        frame.compressed = true;
+        changed.notify_all();
+      }
+
+      ZSTD_freeCCtx(context);
+    }
+
+    void stop()
+    {
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+      }
+      changed.notify_all();
+
+      for (auto& worker : workers)
+        if (worker.joinable())
+          worker.join();
+    }
+
+    std::string fileName;
+    std::ofstream file;
+    int level;
+    std::size_t maxInFlight;
+
+    std::unique_ptr<Frame> current;
+    std::vector<std::pair<std::uint32_t, std::uint32_t>> seekTable;
+
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::deque<std::unique_ptr<Frame>> frames; // submitted, but not yet written
+    std::size_t compressing = 0;               // number of frames taken by workers
+    bool stopping = false;
+    std::atomic<bool> failed{false};
+
+    std::vector<std::thread> workers;
+  };
+}
+#endif
+
+/******************************************************************************/
+
+const unsigned char* BitWriter::append(const unsigned char* data, std::size_t size, std::size_t& length)
+{
+  if (size > 0 && skipBits > 0)
+  {
+    pending = pending << (8 - skipBits) | (data[0] & (0xFF >> skipBits));
+    pendingBits += 8 - skipBits;
+    ++data;
+    --size;
+  }
+  skipBits = 0;
+
+  buffer.clear();
+  if (pendingBits >= 8)
+  {
+    pendingBits -= 8;
+    buffer.push_back(static_cast<unsigned char>(pending >> pendingBits));
+    pending &= (1u << pendingBits) - 1;
+  }
+
+  // Byte aligned again, nothing to shift
+  if (pendingBits == 0 && buffer.empty())
+  {
+    length = size;
+    return data;
+  }
+
+  buffer.reserve(size + 1);
+  for (std::size_t k = 0; k < size; ++k)
+  {
+    buffer.push_back(static_cast<unsigned char>(pending << (8 - pendingBits) | data[k] >> pendingBits));
+    pending = data[k] & ((1u << pendingBits) - 1);
+  }
+
+  length = buffer.size();
+  return buffer.data();
+}
+
+bool BitWriter::flush(unsigned char& last)
+{
+  if (pendingBits == 0)
+    return false;
+
+  last = static_cast<unsigned char>(pending << (8 - pendingBits));
+  pending = pendingBits = 0;
+  return true;
+}
+
+/******************************************************************************/
+
+std::unique_ptr<MergeSink> openOutput(const std::string& fileName, const MergeOptions& options)
+{
+  if (options.compressionLevel > 0)
+  {
+#ifdef BINMERGE_HAVE_ZSTD
+    std::unique_ptr<ZstdSink> output(new ZstdSink(fileName, options.compressionLevel, options.threads));
+    if (output->isOpen())
+      return output;
+
+    std::cerr << "File: " << fileName << " failed to open." << '\n';
+#else
+    std::cerr << "binmerge was built without zstd support." << '\n';
+#endif
+    return nullptr;
+  }
+
+  if (options.splitSize > 0)
+  {
+    std::unique_ptr<SplitFileSink> output(new SplitFileSink(fileName, options.splitSize, options.packetAligned));
+    if (!output->isOpen())
+      return nullptr;
+    return output;
+  }
+
+  std::unique_ptr<FileSink> output(new FileSink(fileName));
+  if (!output->isOpen())
+  {
+    std::cerr << "File: " << fileName << " failed to open." << '\n';
+    return nullptr;
+  }
+  return output;
+}
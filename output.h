@@ -0,0 +1,138 @@
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#include <condition_variable>
+#include <deque>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "binmerge.h"
+
+/******************************************************************************/
+
+// Writes the merged data to a single file
+class FileSink : public MergeSink
+{
+public:
+  explicit FileSink(const std::string& fileName);
+
+  bool isOpen() const { return static_cast<bool>(file); }
+
+  void write(const unsigned char* data, std::size_t size) override;
+  bool finish() override;
+
+private:
+  std::string fileName;
+  std::ofstream file;
+};
+
+/******************************************************************************/
+
+// Writes the merged data to parts of at most partSize bytes, named after the
+// output file with a running number in front of the extension ("rec.001.ts").
+// If packetAligned is set, parts are cut at transport stream packet boundaries.
+class SplitFileSink : public MergeSink
+{
+public:
+  SplitFileSink(const std::string& fileName, std::uint64_t partSize, bool packetAligned);
+  ~SplitFileSink();
+
+  bool isOpen() const { return static_cast<bool>(part); }
+
+  void write(const unsigned char* data, std::size_t size) override;
+  bool finish() override;
+
+  static std::string partName(const std::string& fileName, std::size_t number);
+
+private:
+  class PacketBoundaries;
+
+  void flushHeld(bool final);
+  void writeHeld(std::uint64_t end);
+  void nextPart(std::uint64_t start);
+
+  std::string fileName;
+  std::uint64_t partSize;
+  std::size_t partNumber = 0;
+  std::ofstream part;
+  bool failed = false; // a part could not be opened or written
+
+  std::uint64_t streamOffset = 0; // total number of bytes received
+  std::uint64_t partStart = 0;    // stream offsets covered by the current part
+  std::uint64_t partEnd = 0;
+
+  // Data that cannot be assigned to a part before the next packet boundary is known
+  std::unique_ptr<PacketBoundaries> boundaries;
+  std::vector<unsigned char> held;
+  std::uint64_t heldOffset = 0;
+};
+
+/******************************************************************************/
+
+// Hands the data over to another sink running on a thread of its own. At most
+// queueSize bytes are buffered, so a slow destination only holds up the merge
+// once its queue is full. Only the data is passed on, not the file boundaries.
+class AsyncSink : public MergeSink
+{
+public:
+  explicit AsyncSink(std::unique_ptr<MergeSink> sink, std::size_t queueSize = 64 << 20);
+  ~AsyncSink();
+
+  void write(const unsigned char* data, std::size_t size) override;
+  bool finish() override;
+
+private:
+  void run();
+  void stop(); // writes out the queue and ends the thread
+
+  std::unique_ptr<MergeSink> sink;
+  const std::size_t queueSize;
+
+  std::mutex mutex;
+  std::condition_variable changed;
+  std::deque<std::vector<unsigned char>> queue;
+  std::vector<std::vector<unsigned char>> spare; // written buffers for reuse
+  std::size_t queued = 0;
+  bool finished = false;
+  bool failed = false; // set by the writer thread
+
+  std::thread thread;
+};
+
+/******************************************************************************/
+
+// Joins files whose seams do not fall on byte boundaries into one bit stream
+// (most significant bit first): the data of a file is shifted onto the bits
+// left over from the previous one. The incomplete last byte is padded with
+// zero bits.
+class BitWriter
+{
+public:
+  // Drops the first bits (0-7) of the data appended next
+  void skip(unsigned bits) { skipBits = bits; }
+
+  // Appends the data and returns the bytes completed by it, which stay valid
+  // until the next call (the data itself as long as nothing is shifted)
+  const unsigned char* append(const unsigned char* data, std::size_t size, std::size_t& length);
+
+  // Returns false if no bits are left over, otherwise the padded last byte
+  bool flush(unsigned char& last);
+
+private:
+  std::vector<unsigned char> buffer;
+  unsigned pending = 0;  // bits left over, in the low bits
+  unsigned pendingBits = 0;
+  unsigned skipBits = 0;
+};
+
+/******************************************************************************/
+
+// Opens the output as requested by the options, prints an error and returns
+// nullptr if that fails
+std::unique_ptr<MergeSink> openOutput(const std::string& fileName, const MergeOptions& options);
+
+#endif // OUTPUT_H
@@ -0,0 +1,262 @@
+#include "repair.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <memory>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "copy.h"
+#include "gear.h"
+#include "output.h"
+
+/******************************************************************************/
+
+namespace
+{
+  constexpr std::size_t blockSize = 1 << 20;
+  constexpr std::size_t compareSize = 64 << 10;
+
+  // Anchors of the gear hash (see gear.h)
+  constexpr std::uint64_t window = gearWindow;
+  constexpr int anchorShift = 58; // one anchor per 64 bytes on average
+
+  bool readFully(int fd, unsigned char* buffer, std::uint64_t length, std::uint64_t offset)
+  {
+    while (length > 0)
+    {
+      ssize_t bytesRead = pread(fd, buffer, length, offset);
+      if (bytesRead <= 0)
+        return false;
+
+      buffer += bytesRead;
+      length -= bytesRead;
+      offset += bytesRead;
+    }
+
+    return true;
+  }
+
+  // Number of positions x in [begin, end) (counted from begin, or from end if
+  // backwards) at which the byte equals the byte distance positions earlier
+  std::uint64_t repeatingBytes(int fd, std::uint64_t begin, std::uint64_t end,
+                               std::uint64_t distance, bool backwards)
+  {
+    std::vector<unsigned char> current(compareSize), earlier(compareSize);
+    std::uint64_t count = 0;
+
+    while (count < end - begin)
+    {
+      std::uint64_t length = std::min<std::uint64_t>(compareSize, end - begin - count);
+      std::uint64_t offset = backwards ? end - count - length : begin + count;
+
+      if (!readFully(fd, &current[0], length, offset) ||
+          !readFully(fd, &earlier[0], length, offset - distance))
+        break;
+
+      std::uint64_t equal = 0;
+      if (backwards)
+        while (equal < length && current[length - 1 - equal] == earlier[length - 1 - equal])
+          ++equal;
+      else
+        while (equal < length && current[equal] == earlier[equal])
+          ++equal;
+
+      count += equal;
+      if (equal < length)
+        break;
+    }
+
+    return count;
+  }
+}
+
+/******************************************************************************/
+
+bool findDuplicates(const std::string& fileName, const RepairOptions& options,
+                    std::vector<Duplicate>& duplicates)
+{
+  int file = open(fileName.c_str(), O_RDONLY | O_CLOEXEC);
+  struct stat info;
+
+  if (file < 0 || fstat(file, &info) != 0)
+  {
+    std::cerr << "File: " << fileName << " failed to open." << '\n';
+    if (file >= 0)
+      close(file);
+    return false;
+  }
+
+  posix_fadvise(file, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+  const std::uint64_t fileSize = info.st_size;
+  const std::uint64_t minimumLength = std::max(options.minimumLength, 2 * window);
+
+  // Most recent position (end of the window) of the anchor fingerprints. The
+  // table is direct mapped and sized for twice the anchors within the
+  // lookback; an anchor lost to a collision is made up for by the next one.
+  struct Anchor
+  {
+    std::uint64_t hash = 0;
+    std::uint64_t position = 0;
+  };
+
+  int tableBits = 16;
+  while (tableBits < 40 && (std::uint64_t(1) << tableBits) < 2 * (options.maximumLength >> (64 - anchorShift)))
+    ++tableBits;
+
+  std::vector<Anchor> anchors(std::size_t(1) << tableBits);
+
+  std::vector<unsigned char> buffer(blockSize);
+  std::uint64_t hash = 0;
+  std::uint64_t position = 0;
+  std::uint64_t repaired = 0; // end of the last duplicate, nothing in front is examined again
+
+  duplicates.clear();
+
+  for (;;)
+  {
+    ssize_t bytesRead = read(file, &buffer[0], blockSize);
+    if (bytesRead < 0)
+    {
+      std::cerr << "File: " << fileName << " could not be read." << '\n';
+      close(file);
+      return false;
+    }
+
+    if (bytesRead == 0)
+      break;
+
+    for (ssize_t k = 0; k < bytesRead; ++k)
+    {
+      hash = gearUpdate(hash, buffer[k]);
+      ++position;
+
+      if (position < window || (hash >> anchorShift) != 0)
+        continue;
+
+      // The low bits only depend on the last few bytes, so mix before indexing
+      Anchor& anchor = anchors[(hash * 0x9E3779B97F4A7C15ull) >> (64 - tableBits)];
+      bool seen = anchor.hash == hash && anchor.position > 0;
+      std::uint64_t distance = position - anchor.position;
+
+      anchor.hash = hash;
+      anchor.position = position;
+
+      if (!seen)
+        continue;
+
+      if (distance < minimumLength || distance > options.maximumLength || position - window < repaired)
+        continue;
+
+      // The window repeats; find out how far the repetition reaches. Even if
+      // it covers several periods, the content remains unchanged when the
+      // leading periods are removed.
+      std::uint64_t floor = std::max(repaired, distance);
+      std::uint64_t before = repeatingBytes(file, floor, position, distance, true);
+      std::uint64_t after = repeatingBytes(file, position, fileSize, distance, false);
+
+      std::uint64_t start = position - before;
+      std::uint64_t periods = (before + after) / distance;
+      if (periods == 0)
+        continue;
+
+      duplicates.push_back(Duplicate{start, periods * distance});
+      repaired = start + before + after;
+    }
+  }
+
+  close(file);
+  return true;
+}
+
+std::vector<Extent> repairExtents(std::uint64_t fileSize, const std::vector<Duplicate>& duplicates)
+{
+  std::vector<Extent> extents;
+  std::uint64_t sourceOffset = 0, outputOffset = 0;
+
+  for (const auto& duplicate : duplicates)
+  {
+    extents.push_back(Extent{0, sourceOffset, outputOffset, duplicate.offset - sourceOffset});
+    outputOffset += duplicate.offset - sourceOffset;
+    sourceOffset = duplicate.offset + duplicate.length;
+  }
+
+  extents.push_back(Extent{0, sourceOffset, outputOffset, fileSize - sourceOffset});
+  return extents;
+}
+
+bool saveRepairPlan(const std::string& planFileName, const std::string& fileName,
+                    std::uint64_t fileSize, std::int64_t modificationTime,
+                    const std::vector<Duplicate>& duplicates)
+{
+  std::ofstream planFile(planFileName);
+
+  planFile << "binmerge-repair 1\n"
+           << "file " << fileSize << ' ' << modificationTime << ' ' << fileName << '\n';
+
+  for (const auto& duplicate : duplicates)
+    planFile << "duplicate " << duplicate.offset << ' ' << duplicate.length << '\n';
+
+  return static_cast<bool>(planFile);
+}
+
+/******************************************************************************/
+
+bool writeExtents(const std::vector<std::string>& fileNames, const std::vector<Extent>& extents,
+                  const std::vector<std::string>& outputFileNames, const MergeOptions& options)
+{
+  // Same shortcut as in mergeFiles()
+  if (outputFileNames.size() == 1 && options.splitSize == 0 && options.compressionLevel == 0 &&
+      copyExtents(fileNames, extents, outputFileNames.front(), options.threads, options.maxOpen))
+    return true;
+
+  std::vector<std::unique_ptr<MergeSink>> outputs;
+  for (const auto& outputFileName : outputFileNames)
+  {
+    std::unique_ptr<MergeSink> output = openOutput(outputFileName, options);
+    if (!output)
+      return false;
+
+    if (outputFileNames.size() > 1)
+      output.reset(new AsyncSink(std::move(output)));
+    outputs.push_back(std::move(output));
+  }
+
+  std::vector<unsigned char> buffer(blockSize);
+
+  for (const auto& extent : extents)
+  {
+    int input = open(fileNames[extent.file].c_str(), O_RDONLY | O_CLOEXEC);
+    if (input < 0)
+    {
+      std::cerr << "File: " << fileNames[extent.file] << " failed to open." << '\n';
+      return false;
+    }
+
+    for (std::uint64_t offset = 0; offset < extent.length; offset += blockSize)
+    {
+      std::size_t length = std::min<std::uint64_t>(blockSize, extent.length - offset);
+      if (!readFully(input, &buffer[0], length, extent.sourceOffset + offset))
+      {
+        std::cerr << "File: " << fileNames[extent.file] << " could not be read." << '\n';
+        close(input);
+        return false;
+      }
+
+      for (auto& output : outputs)
+        output->write(&buffer[0], length);
+    }
+
+    close(input);
+  }
+
+  bool written = true;
+  for (auto& output : outputs)
+    written = output->finish() && written;
+
+  return written;
+}
@@ -0,0 +1,52 @@
+#ifndef REPAIR_H
+#define REPAIR_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "binmerge.h"
+
+/******************************************************************************/
+
+// Range of a file that merely repeats the bytes right in front of it, as left
+// behind by concatenating overlapping segments without merging them
+struct Duplicate
+{
+  std::uint64_t offset;
+  std::uint64_t length;
+};
+
+struct RepairOptions
+{
+  // Shorter repetitions are considered to be part of the content
+  std::uint64_t minimumLength = 4096;
+  // Longest repetition that can be found, bounds the memory used
+  std::uint64_t maximumLength = 64 << 20;
+};
+
+// Finds all duplicates of a file in a single pass. Windows of the data are
+// fingerprinted with a rolling hash; some of them (chosen by content) are
+// remembered, and a fingerprint seen again within the lookback is checked
+// byte by byte for a repetition of the preceding bytes.
+bool findDuplicates(const std::string& fileName, const RepairOptions& options,
+                    std::vector<Duplicate>& duplicates);
+
+// The parts of a file of the given size that remain after removing the duplicates
+std::vector<Extent> repairExtents(std::uint64_t fileSize, const std::vector<Duplicate>& duplicates);
+
+// Stores the duplicates of a file, so that they can be collapsed in place by
+// other tools (from the end backwards, as offsets refer to the original file):
+//
+//   binmerge-repair 1
+//   file <size> <modification time> <name>
+//   duplicate <offset> <length>
+bool saveRepairPlan(const std::string& planFileName, const std::string& fileName,
+                    std::uint64_t fileSize, std::int64_t modificationTime,
+                    const std::vector<Duplicate>& duplicates);
+
+// Copies the extents of the files to the output(s)
+bool writeExtents(const std::vector<std::string>& fileNames, const std::vector<Extent>& extents,
+                  const std::vector<std::string>& outputFileNames, const MergeOptions& options);
+
+#endif // REPAIR_H
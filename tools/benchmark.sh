@@ -0,0 +1,81 @@
+#!/bin/sh
+# Runs binmerge on the corpus of tools/corpus.py, checks the results and
+# prints the time of every workload. Also the training workload of
+# tools/pgo-build.sh, so it should cover what matters in practice.
+#
+# Usage: tools/benchmark.sh BINARY CORPUS_DIR [WORK_DIR]
+
+set -e
+
+if [ $# -lt 2 ]; then
+  echo "Usage: $0 BINARY CORPUS_DIR [WORK_DIR]" >&2
+  exit 1
+fi
+
+binary=$1
+corpus=$2
+keep=$3
+work=${3:-$(mktemp -d)}
+mkdir -p "$work"
+
+failed=0
+
+# run NAME EXPECTED OUTPUT COMMAND...: times the command and compares the
+# output to the expected file (if any)
+run() {
+  name=$1 expected=$2 output=$3
+  shift 3
+
+  start=$(date +%s%N)
+  if ! "$@" > "$work/$name.log" 2>&1; then
+    printf '%-12s failed, see %s\n' "$name" "$work/$name.log"
+    failed=1
+    return
+  fi
+  end=$(date +%s%N)
+
+  result=ok
+  if [ -n "$expected" ] && ! cmp -s "$expected" "$output"; then
+    result=MISMATCH
+    failed=1
+  fi
+
+  printf '%-12s %6d ms  %s\n' "$name" $(( (end - start) / 1000000 )) "$result"
+}
+
+plain="$corpus/plain/seg*.bin"
+ts="$corpus/ts/seg*.ts"
+
+run merge "$corpus/plain/expected.bin" "$work/plain.bin" \
+  "$binary" -y -b -o "$work/plain.bin" $plain
+run fused "$corpus/plain/expected.bin" "$work/fused.bin" \
+  "$binary" -y -q --fused -o "$work/fused.bin" $plain
+run checksum "$corpus/plain/expected.bin" "$work/sum.bin" \
+  "$binary" -y -q -b --checksum xxh3,blake3,sha256 -o "$work/sum.bin" $plain
+run ts "$corpus/ts/expected.ts" "$work/ts.ts" \
+  "$binary" -y -b --ts --index --save-plan "$work/ts.plan" -o "$work/ts.ts" $ts
+run verify "" "" \
+  "$binary" -y -q --plan "$work/ts.plan" --verify -o "$work/ts.ts"
+run tee "$corpus/ts/expected.ts" "$work/tee2.ts" \
+  "$binary" -y -q -b --ts -o "$work/tee1.ts" -o "$work/tee2.ts" $ts
+run split "" "" \
+  "$binary" -y -q -b --ts --split-size 8M -o "$work/split.ts" $ts
+run repair "$corpus/ts/expected.ts" "$work/repaired.ts" \
+  "$binary" -y -q --repair "$corpus/concat.ts" -o "$work/repaired.ts"
+
+# Compressed output and input, only if built with libzstd (otherwise no
+# output is written)
+set -- $ts
+run compress "" "" \
+  "$binary" -y -q -b --ts --compress zstd -o "$work/head.zst" "$1" "$2"
+shift 2
+
+if [ -s "$work/head.zst" ]; then
+  run zstd-input "$corpus/ts/expected.ts" "$work/unzst.ts" \
+    "$binary" -y -q -b --ts -o "$work/unzst.ts" "$work/head.zst" "$@"
+else
+  echo "zstd         skipped"
+fi
+
+[ -z "$keep" ] && rm -rf "$work"
+exit $failed
@@ -0,0 +1,110 @@
+#!/usr/bin/env python3
+"""Generates the benchmark corpus used by tools/benchmark.sh.
+
+The corpus consists of overlapping segments as they are produced by split
+recordings, together with the expected merge results:
+
+  plain/seg*.bin   random data, overlaps of varying length, one seam with a
+                   few corrupted bytes in the overlap
+  plain/expected.bin
+  ts/seg*.ts       MPEG transport stream (188 byte packets, PCR every 30
+                   packets), cut at arbitrary positions
+  ts/expected.ts
+  concat.ts        the TS segments naively concatenated, for --repair
+
+The content only depends on the seed, so the corpus is reproducible.
+"""
+
+import argparse
+import os
+import random
+
+
+def random_bytes(rng, size):
+    """Returns size random bytes, generated in chunks (randbytes() is limited
+    to less than 256 MiB)."""
+    chunk = 16 << 20
+    return b''.join(rng.randbytes(min(chunk, size - offset)) for offset in range(0, size, chunk))
+
+
+def transport_stream(rng, size):
+    """Returns size bytes of a transport stream with a video PID carrying
+    PCRs, an audio PID and null packets."""
+    packets = []
+    counters = {}
+    pcr = 0
+
+    for k in range((size + 187) // 188):
+        pid = (0x100, 0x101, 0x100, 0x1FFF)[k % 4]
+        counter = counters.get(pid, 0)
+        counters[pid] = (counter + 1) % 16
+
+        if pid == 0x1FFF:
+            packets.append(bytes([0x47, 0x1F, 0xFF, 0x10]) + b'\xff' * 184)
+        elif pid == 0x100 and k % 30 == 0:
+            # PCR in the adaptation field, 40 ms apart
+            pcr += 27000000 // 25
+            base, extension = pcr // 300 % (1 << 33), pcr % 300
+            field = bytes([7, 0x10,
+                           base >> 25 & 0xFF, base >> 17 & 0xFF, base >> 9 & 0xFF, base >> 1 & 0xFF,
+                           (base & 1) << 7 | 0x7E | extension >> 8, extension & 0xFF])
+            packets.append(bytes([0x47, 0x01, 0x00, 0x30 | counter]) + field + rng.randbytes(184 - len(field)))
+        else:
+            packets.append(bytes([0x47, pid >> 8, pid & 0xFF, 0x10 | counter]) + rng.randbytes(184))
+
+    return b''.join(packets)[:size]
+
+
+def write_segments(rng, directory, data, segments, extension, corrupt):
+    """Cuts data into overlapping segments and writes them together with
+    the expected merge result. Returns the segment file names."""
+    os.makedirs(directory, exist_ok=True)
+
+    length = len(data) // segments
+    names = []
+
+    for i in range(segments):
+        # Overlaps from a few KiB up to 1 MiB (or half a segment)
+        overlap = rng.randrange(8192, max(8193, min(1 << 20, length // 2))) if i > 0 else 0
+        start = max(0, i * length - overlap)
+        end = len(data) if i == segments - 1 else (i + 1) * length
+        segment = bytearray(data[start:end])
+
+        # Some bytes of one overlap differ (e.g. reception errors)
+        if corrupt and i == segments // 2:
+            for _ in range(16):
+                segment[rng.randrange(overlap // 2)] ^= 0xFF
+
+        name = os.path.join(directory, 'seg%03d.%s' % (i, extension))
+        with open(name, 'wb') as file:
+            file.write(segment)
+        names.append(name)
+
+    with open(os.path.join(directory, 'expected.' + extension), 'wb') as file:
+        file.write(data)
+
+    return names
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument('directory', help='directory to create the corpus in')
+    parser.add_argument('--size', type=int, default=256, help='size of each data set in MiB (default: 256)')
+    parser.add_argument('--segments', type=int, default=16, help='segments per data set (default: 16)')
+    parser.add_argument('--seed', type=int, default=1, help='seed of the random data (default: 1)')
+    args = parser.parse_args()
+
+    rng = random.Random(args.seed)
+    size = args.size << 20
+
+    write_segments(rng, os.path.join(args.directory, 'plain'), random_bytes(rng, size), args.segments, 'bin', True)
+    names = write_segments(rng, os.path.join(args.directory, 'ts'), transport_stream(rng, size), args.segments, 'ts', False)
+
+    with open(os.path.join(args.directory, 'concat.ts'), 'wb') as concat:
+        for name in names:
+            with open(name, 'rb') as file:
+                concat.write(file.read())
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,50 @@
+#!/bin/sh
+# Builds the release binary with link time and profile-guided optimization:
+#   1. build an instrumented binary (BINMERGE_PGO=generate)
+#   2. run tools/benchmark.sh on a generated corpus to collect the profile
+#   3. rebuild with the profile (BINMERGE_PGO=use)
+# The result is the usual bin/binmerge. The profile is specific to the
+# compiler and the sources, so this has to be repeated after changes.
+#
+# Usage: tools/pgo-build.sh [BUILD_DIR] [CORPUS_DIR]
+# Both default to directories below build-pgo/. An existing corpus is
+# reused; CMAKE_CXX_COMPILER and CORPUS_SIZE (MiB) are taken from the
+# environment.
+
+set -e
+
+source=$(cd "$(dirname "$0")/.." && pwd)
+build=${1:-$source/build-pgo}
+corpus=${2:-$build/corpus}
+profile=$build/profile
+binary=$source/bin/binmerge
+
+mkdir -p "$build"
+cd "$build"
+
+# Both stages use the same build directory, since GCC looks up the profile
+# of every object file by its path
+echo "== Stage 1: instrumented build"
+rm -rf "$profile"
+cmake -DCMAKE_BUILD_TYPE=Release -DBINMERGE_LTO=ON -DBINMERGE_PGO=generate \
+      -DBINMERGE_PGO_DIR="$profile" ${CMAKE_CXX_COMPILER:+-DCMAKE_CXX_COMPILER="$CMAKE_CXX_COMPILER"} \
+      "$source"
+cmake --build . --clean-first
+
+echo "== Training"
+if [ ! -f "$corpus/concat.ts" ]; then
+  python3 "$source/tools/corpus.py" --size "${CORPUS_SIZE:-256}" "$corpus"
+fi
+sh "$source/tools/benchmark.sh" "$binary" "$corpus"
+
+# Clang writes raw profiles that have to be merged first
+if ls "$profile"/*.profraw > /dev/null 2>&1; then
+  llvm-profdata merge -output="$profile/binmerge.profdata" "$profile"/*.profraw
+fi
+
+echo "== Stage 2: optimized build"
+cmake -DBINMERGE_PGO=use .
+cmake --build . --clean-first
+
+echo "== Optimized binary: $binary"
+sh "$source/tools/benchmark.sh" "$binary" "$corpus"
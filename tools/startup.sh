@@ -0,0 +1,40 @@
+#!/usr/bin/env bash
+# Measures the startup cost of binmerge: the CPU time of a trivial merge of
+# two tiny files, averaged over many runs. The same command line is run once
+# as is and once with combined flags ("-qy"), which is left to docopt. The
+# cost of starting /bin/true is given for reference.
+#
+# Usage: tools/startup.sh BINARY [RUNS]
+
+set -e
+
+if [ $# -lt 1 ]; then
+  echo "Usage: $0 BINARY [RUNS]" >&2
+  exit 1
+fi
+
+binary=$1
+runs=${2:-1000}
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+
+printf 'abcdefghijklmnopqrstuvwxyz0123456789' > "$work/a"
+printf 'qrstuvwxyz0123456789ABCDEFGHIJKLMNOP' > "$work/b"
+
+# measure NAME COMMAND...: prints the CPU time per run of the command
+measure() {
+  name=$1
+  shift
+
+  TIMEFORMAT='%3U %3S'
+  times=$( { time for ((i = 0; i < runs; ++i)); do "$@" > /dev/null < /dev/null; done; } 2>&1 )
+  read -r user sys <<< "$times"
+
+  awk -v name="$name" -v user="$user" -v sys="$sys" -v runs="$runs" \
+    'BEGIN { printf "%-8s user %6.0f us  system %6.0f us  per run\n", name, user * 1e6 / runs, sys * 1e6 / runs }'
+}
+
+# Starting any program from the shell loop costs this much
+measure baseline /bin/true
+measure simple "$binary" -q -y -o "$work/out" "$work/a" "$work/b"
+measure docopt "$binary" -qy -o "$work/out" "$work/a" "$work/b"
@@ -0,0 +1,103 @@
+#include "trim.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/******************************************************************************/
+
+namespace
+{
+  // Removes the first length bytes of the file, returns false if the file
+  // system cannot do that (or length is not a multiple of its block size)
+  bool collapseHead(int fd, std::uint64_t length)
+  {
+#ifdef FALLOC_FL_COLLAPSE_RANGE
+    return fallocate(fd, FALLOC_FL_COLLAPSE_RANGE, 0, length) == 0;
+#else
+    errno = EOPNOTSUPP;
+    return false;
+#endif
+  }
+
+  bool truncateTail(const std::string& fileName, std::uint64_t length)
+  {
+    // A tiny file may be part of the overlap entirely
+    struct stat info;
+    bool truncated = stat(fileName.c_str(), &info) == 0 &&
+                     (length = std::min<std::uint64_t>(length, info.st_size),
+                      truncate(fileName.c_str(), info.st_size - length) == 0);
+
+    if (!truncated)
+    {
+      std::cerr << "File: " << fileName << " could not be truncated: " << std::strerror(errno) << '\n';
+      return false;
+    }
+
+    std::cout << getFilename(fileName) << ": removed " << length << " bytes from the tail\n";
+    return true;
+  }
+}
+
+/******************************************************************************/
+
+bool trimInPlace(const std::vector<std::string>& fileNames,
+                 const std::vector<MatchResult>& searchResults,
+                 double minimumQuota, bool heads)
+{
+  for (std::size_t i = 0; i < searchResults.size(); ++i)
+  {
+    const auto& result = searchResults[i];
+
+    if (!result.patternFound || result.quota() < minimumQuota)
+    {
+      std::cout << "Seam of " << getFilename(fileNames[i]) << " and "
+                << getFilename(fileNames[i+1]) << " left alone\n";
+      continue;
+    }
+
+    std::uint64_t overlap = result.overlapCount();
+    std::uint64_t tail = overlap;
+
+    if (heads)
+    {
+      int fd = open(fileNames[i+1].c_str(), O_RDWR | O_CLOEXEC);
+      struct stat info;
+
+      if (fd < 0 || fstat(fd, &info) != 0)
+      {
+        std::cerr << "File: " << fileNames[i+1] << " failed to open." << '\n';
+        if (fd >= 0)
+          close(fd);
+        return false;
+      }
+
+      // Only whole blocks can be collapsed, and never the end of the file
+      std::uint64_t blockSize = info.st_blksize;
+      std::uint64_t head = overlap / blockSize * blockSize;
+      if (head >= static_cast<std::uint64_t>(info.st_size))
+        head = 0;
+
+      if (head > 0 && collapseHead(fd, head))
+      {
+        std::cout << getFilename(fileNames[i+1]) << ": removed " << head << " bytes from the head\n";
+        tail = overlap - head;
+      }
+      else if (head > 0)
+        std::cout << getFilename(fileNames[i+1]) << ": collapsing not supported ("
+                  << std::strerror(errno) << "), trimming the predecessor instead\n";
+
+      close(fd);
+    }
+
+    if (tail > 0 && !truncateTail(fileNames[i], tail))
+      return false;
+  }
+
+  return true;
+}
@@ -0,0 +1,24 @@
+#ifndef TRIM_H
+#define TRIM_H
+
+#include <string>
+#include <vector>
+
+#include "binmerge.h"
+
+/******************************************************************************/
+
+// Removes the overlap of every seam from one of its two files in place, so
+// that simply concatenating the files yields the merged output. Seams below
+// the minimum quota are left alone.
+//
+// By default the predecessor's tail is truncated, which does not move any
+// data. With heads set, the overlap is removed from the head of the next file
+// instead, as far as the file system can collapse it (whole blocks); the rest
+// is truncated from the predecessor. If collapsing is not supported, the
+// predecessor's tail is truncated after all.
+bool trimInPlace(const std::vector<std::string>& fileNames,
+                 const std::vector<MatchResult>& searchResults,
+                 double minimumQuota, bool heads);
+
+#endif // TRIM_H
@@ -0,0 +1,162 @@
+#include "ts.h"
+
+#include <algorithm>
+
+/******************************************************************************/
+
+std::size_t detectPacketSize(const unsigned char* data, std::size_t size)
+{
+  constexpr std::size_t packetsRequired = 5;
+
+  for (std::size_t packetSize : {188, 192, 204})
+  {
+    std::size_t offset = syncOffset(packetSize);
+    if (offset + (packetsRequired - 1) * packetSize >= size)
+      continue;
+
+    std::size_t k = 0;
+    while (k < packetsRequired && data[offset + k * packetSize] == tsSyncByte)
+      ++k;
+
+    if (k == packetsRequired)
+      return packetSize;
+  }
+
+  return 0;
+}
+
+bool findPacketGrid(const unsigned char* data, std::size_t size,
+                    std::size_t& packetSize, std::size_t& offset)
+{
+  for (offset = 0; offset < 204 && offset < size; ++offset)
+  {
+    packetSize = detectPacketSize(data + offset, size - offset);
+    if (packetSize != 0 && offset < packetSize)
+      return true;
+  }
+
+  return false;
+}
+
+bool readPcr(const unsigned char* packet, std::uint64_t& pcr)
+{
+  // Adaptation field present, long enough and PCR flag set
+  if (!(packet[3] & 0x20) || packet[4] < 7 || !(packet[5] & 0x10))
+    return false;
+
+  std::uint64_t base = std::uint64_t(packet[6]) << 25 | std::uint64_t(packet[7]) << 17 |
+                       std::uint64_t(packet[8]) << 9  | std::uint64_t(packet[9]) << 1 |
+                       packet[10] >> 7;
+  std::uint64_t extension = (packet[10] & 1) << 8 | packet[11];
+
+  pcr = base * 300 + extension;
+  return true;
+}
+
+/******************************************************************************/
+
+namespace
+{
+  // Enough data for detecting any supported packet size
+  constexpr std::size_t detectionSize = 8 * 204;
+}
+
+TsParser::TsParser(std::size_t packetSize)
+  : size(packetSize)
+{
+}
+
+void TsParser::parse(const unsigned char* data, std::size_t length)
+{
+  // Packets of all sizes at the beginning of the stream have to be seen first
+  if (size == 0)
+  {
+    carry.insert(carry.end(), data, data + length);
+    if (carry.size() < detectionSize)
+      return;
+
+    size = detectPacketSize(carry.data(), carry.size());
+    if (size == 0)
+      size = 188;
+
+    data = nullptr;
+    length = 0;
+  }
+
+  const std::size_t sync = syncOffset(size);
+
+  // Hands out all complete packets of a buffer, returns the number of bytes consumed
+  auto process = [&](const unsigned char* buffer, std::size_t bufferSize, std::uint64_t offset)
+  {
+    std::size_t position = 0;
+
+    while (position + size <= bufferSize)
+    {
+      if (buffer[position + sync] == tsSyncByte)
+      {
+        std::size_t count = 1;
+        while (position + (count + 1) * size <= bufferSize &&
+               buffer[position + count * size + sync] == tsSyncByte)
+          ++count;
+
+        packets(&buffer[position + sync], count, offset + position);
+        position += count * size;
+        continue;
+      }
+
+      // Lost sync, continue at the next sync byte
+      ++resyncs;
+      auto next = std::find(&buffer[position + sync + 1], &buffer[bufferSize], tsSyncByte);
+      position = next != &buffer[bufferSize] ? next - buffer - sync
+                                             : std::max(position + 1, bufferSize - sync);
+    }
+
+    return position;
+  };
+
+  // Complete the packet carried over from the last call first
+  if (!carry.empty())
+  {
+    std::size_t carried = carry.size();
+    std::size_t appended = std::min(length, size);
+    carry.insert(carry.end(), data, data + appended);
+
+    std::size_t consumed = process(carry.data(), carry.size(), carryOffset);
+
+    if (appended == length)
+    {
+      carry.erase(carry.begin(), carry.begin() + consumed);
+      carryOffset += consumed;
+      return;
+    }
+
+    if (consumed < carried)
+    {
+      // Only possible while regaining sync, process both parts as one buffer
+      std::vector<unsigned char> buffer(carry.begin() + consumed, carry.end());
+      buffer.insert(buffer.end(), data + appended, data + length);
+      carryOffset += consumed;
+
+      consumed = process(buffer.data(), buffer.size(), carryOffset);
+      carry.assign(buffer.begin() + consumed, buffer.end());
+      carryOffset += consumed;
+      return;
+    }
+
+    data += consumed - carried;
+    length -= consumed - carried;
+    carryOffset += consumed;
+    carry.clear();
+  }
+
+  std::size_t consumed = process(data, length, carryOffset);
+
+  carry.assign(data + consumed, data + length);
+  carryOffset += consumed;
+}
+
+void TsParser::packets(const unsigned char* first, std::size_t count, std::uint64_t offset)
+{
+  for (std::size_t k = 0; k < count; ++k)
+    packet(first + k * size, offset + k * size);
+}
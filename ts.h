@@ -0,0 +1,82 @@
+#ifndef TS_H
+#define TS_H
+
+#include <cstdint>
+#include <vector>
+
+/******************************************************************************/
+
+// MPEG transport stream helpers. Besides plain 188 byte packets, 192 byte
+// packets (M2TS, 4 byte time code in front) and 204 byte packets (16 bytes
+// of Reed-Solomon parity at the end) are supported.
+
+constexpr unsigned char tsSyncByte = 0x47;
+
+// PCR values wrap around after 2^33 * 300 ticks of the 27 MHz clock
+constexpr std::uint64_t pcrWrap = (std::uint64_t(1) << 33) * 300;
+constexpr std::uint64_t pcrTicksPerSecond = 27000000;
+
+// Returns 188, 192 or 204 if the data starts with at least a few packets of
+// that size, 0 otherwise
+std::size_t detectPacketSize(const unsigned char* data, std::size_t size);
+
+// Like detectPacketSize(), but the first packet may start anywhere within the
+// first packet size bytes (e.g. after a cut). Returns false if no packets
+// were found, otherwise the packet size and the offset of the first packet.
+bool findPacketGrid(const unsigned char* data, std::size_t size,
+                    std::size_t& packetSize, std::size_t& offset);
+
+// Offset of the sync byte within a packet of the given size
+inline std::size_t syncOffset(std::size_t packetSize)
+{
+  return packetSize == 192 ? 4 : 0;
+}
+
+// Accessors for a packet starting at its sync byte
+inline std::uint16_t packetPid(const unsigned char* packet)
+{
+  return static_cast<std::uint16_t>((packet[1] & 0x1F) << 8 | packet[2]);
+}
+
+bool readPcr(const unsigned char* packet, std::uint64_t& pcr);
+
+// Forward distance between two PCR values, taking the wrap around into account
+inline std::uint64_t pcrDistance(std::uint64_t from, std::uint64_t to)
+{
+  return (to + pcrWrap - from) % pcrWrap;
+}
+
+/******************************************************************************/
+
+// Splits a byte stream into packets regardless of how it is chunked. Derived
+// classes receive every packet (starting at its sync byte) together with the
+// stream offset of the packet, either one by one or as runs of consecutive
+// packets (for tight loops over many packets). Lost sync is regained at the
+// next sync byte.
+class TsParser
+{
+public:
+  // A packet size of 0 means detecting it from the beginning of the stream
+  explicit TsParser(std::size_t packetSize = 0);
+  virtual ~TsParser() = default;
+
+  void parse(const unsigned char* data, std::size_t size);
+
+  std::size_t packetSize() const { return size; }
+  std::uint64_t resyncCount() const { return resyncs; }
+
+protected:
+  virtual void packet(const unsigned char*, std::uint64_t) {}
+
+  // Receives count packets, packetSize() bytes apart, the first one at the
+  // given stream offset; passes them on to packet() unless overridden
+  virtual void packets(const unsigned char* first, std::size_t count, std::uint64_t offset);
+
+private:
+  std::size_t size;
+  std::vector<unsigned char> carry; // incomplete packet from the previous call
+  std::uint64_t carryOffset = 0;    // stream offset of the carried data
+  std::uint64_t resyncs = 0;
+};
+
+#endif // TS_H
@@ -0,0 +1,200 @@
+#include "tsstats.h"
+
+#include <iomanip>
+#include <iostream>
+
+#include "inputs.h"
+#include "ts.h"
+
+/******************************************************************************/
+
+namespace
+{
+  constexpr std::uint16_t nullPid = 0x1FFF;
+  constexpr std::uint64_t maximumPcrDistance = pcrTicksPerSecond / 10;
+
+  struct Counts
+  {
+    std::uint64_t continuityErrors = 0;
+    std::uint64_t transportErrors = 0;
+    std::uint64_t pcrJumps = 0;
+
+    bool any() const { return continuityErrors || transportErrors || pcrJumps; }
+  };
+
+  std::ostream& operator<<(std::ostream& stream, const Counts& counts)
+  {
+    return stream << counts.continuityErrors << " continuity, " << counts.transportErrors
+                  << " transport, " << counts.pcrJumps << " PCR";
+  }
+}
+
+/******************************************************************************/
+
+// All PIDs are looked up in a table, so that every run of packets is checked
+// in a single loop without branching into other code
+class TsStatsSink::Checker : public TsParser
+{
+public:
+  struct Pid
+  {
+    std::uint64_t packets = 0;
+    Counts counts;
+
+    // State of the last packet
+    int continuityCounter = -1; // -1 before the first packet with payload
+    std::uint64_t lastOffset = 0;
+    bool hasPcr = false;
+    std::uint64_t pcr = 0;
+    std::uint64_t pcrOffset = 0;
+  };
+
+  std::vector<Pid> pids = std::vector<Pid>(8192);
+  std::vector<Counts> files, seams;
+  std::vector<std::uint64_t> seamOffsets;
+  std::uint64_t packetCount = 0;
+
+  void beginFile(std::uint64_t outputOffset)
+  {
+    files.emplace_back();
+    if (files.size() > 1)
+    {
+      seams.emplace_back();
+      seamOffsets.push_back(outputOffset);
+    }
+  }
+
+protected:
+  void packets(const unsigned char* first, std::size_t count, std::uint64_t offset) override
+  {
+    const std::size_t size = packetSize();
+
+    // Without beginFile() (e.g. when combining recordings), all is one file
+    if (files.empty())
+      files.emplace_back();
+
+    Counts& file = files.back();
+    std::uint64_t seamOffset = seamOffsets.empty() ? 0 : seamOffsets.back();
+    packetCount += count;
+
+    for (std::size_t k = 0; k < count; ++k, offset += size)
+    {
+      const unsigned char* packet = first + k * size;
+      std::uint16_t pid = packetPid(packet);
+      if (pid == nullPid)
+        continue;
+
+      Pid& state = pids[pid];
+      ++state.packets;
+
+      // A packet spanning the current seam is the seam's fault
+      bool acrossSeam = !seams.empty() && state.lastOffset < seamOffset && state.packets > 1;
+      state.lastOffset = offset;
+
+      if (packet[1] & 0x80)
+      {
+        ++state.counts.transportErrors;
+        ++file.transportErrors;
+        continue;
+      }
+
+      bool adaptationField = packet[3] & 0x20;
+      bool payload = packet[3] & 0x10;
+      bool discontinuity = adaptationField && packet[4] > 0 && (packet[5] & 0x80);
+
+      // The counter only advances with payload, a single repetition is allowed
+      int continuityCounter = packet[3] & 0x0F;
+      if (payload)
+      {
+        if (state.continuityCounter >= 0 && !discontinuity &&
+            continuityCounter != state.continuityCounter &&
+            continuityCounter != ((state.continuityCounter + 1) & 0x0F))
+        {
+          ++state.counts.continuityErrors;
+          ++file.continuityErrors;
+          if (acrossSeam)
+            ++seams.back().continuityErrors;
+        }
+
+        state.continuityCounter = continuityCounter;
+      }
+
+      std::uint64_t pcr;
+      if (adaptationField && readPcr(packet, pcr))
+      {
+        if (state.hasPcr && !discontinuity && pcrDistance(state.pcr, pcr) > maximumPcrDistance)
+        {
+          ++state.counts.pcrJumps;
+          ++file.pcrJumps;
+          if (!seams.empty() && state.pcrOffset < seamOffset)
+            ++seams.back().pcrJumps;
+        }
+
+        state.hasPcr = true;
+        state.pcr = pcr;
+        state.pcrOffset = offset;
+      }
+    }
+  }
+};
+
+/******************************************************************************/
+
+TsStatsSink::TsStatsSink()
+  : checker(new Checker)
+{
+}
+
+TsStatsSink::~TsStatsSink() = default;
+
+void TsStatsSink::beginMerge(const InputFiles& inputs, const std::vector<MatchResult>&)
+{
+  this->inputs = &inputs;
+}
+
+void TsStatsSink::beginFile(std::size_t, std::uint64_t outputOffset)
+{
+  checker->beginFile(outputOffset);
+}
+
+void TsStatsSink::write(const unsigned char* data, std::size_t size)
+{
+  checker->parse(data, size);
+}
+
+bool TsStatsSink::finish()
+{
+  const Checker& stats = *checker;
+
+  std::cout << "\nTransport stream (" << stats.packetSize() << " byte packets): "
+            << stats.packetCount << " packets, sync lost " << stats.resyncCount() << " times\n";
+
+  std::cout << "PIDs (continuity errors, transport errors, PCR jumps):\n";
+  for (std::size_t pid = 0; pid < stats.pids.size(); ++pid)
+  {
+    const auto& state = stats.pids[pid];
+    if (state.packets == 0)
+      continue;
+
+    std::cout << "  0x" << std::hex << std::setfill('0') << std::setw(4) << pid
+              << std::dec << std::setfill(' ') << ": " << state.packets << " packets, "
+              << state.counts << '\n';
+  }
+
+  if (inputs)
+  {
+    std::cout << "Files:\n";
+    for (std::size_t i = 0; i < stats.files.size(); ++i)
+      std::cout << "  " << getFilename(inputs->name(i)) << ": " << stats.files[i] << '\n';
+  }
+
+  if (!stats.seams.empty())
+  {
+    std::cout << "Seams:\n";
+    for (std::size_t i = 0; i < stats.seams.size(); ++i)
+      std::cout << "  " << i+1 << " (output offset " << stats.seamOffsets[i] << "): "
+                << stats.seams[i] << (stats.seams[i].any() ? "  <--" : "") << '\n';
+  }
+
+  return true;
+}
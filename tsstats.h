@@ -0,0 +1,41 @@
+#ifndef TSSTATS_H
+#define TSSTATS_H
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "binmerge.h"
+
+/******************************************************************************/
+
+// Checks the merged transport stream while it is being written and prints,
+// once merging is done, per PID, per input file and per seam:
+//
+//   - continuity errors (continuity counter not incremented by one),
+//   - packets with the transport error indicator set,
+//   - PCR jumps (backwards or by more than 100 ms) without a discontinuity
+//     indicator.
+//
+// A continuity error (PCR jump) is counted at a seam as well if the previous
+// packet (PCR) of its PID lies in front of the seam, which is the signature
+// of a seam that lost or repeated packets.
+class TsStatsSink : public MergeSink
+{
+public:
+  TsStatsSink();
+  ~TsStatsSink();
+
+  void beginMerge(const InputFiles& inputs, const std::vector<MatchResult>& searchResults) override;
+  void beginFile(std::size_t i, std::uint64_t outputOffset) override;
+  void write(const unsigned char* data, std::size_t size) override;
+  bool finish() override;
+
+private:
+  class Checker;
+
+  const InputFiles* inputs = nullptr;
+  std::unique_ptr<Checker> checker;
+};
+
+#endif // TSSTATS_H
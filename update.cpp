@@ -0,0 +1,172 @@
+#include "update.h"
+
+#include <algorithm>
+#include <iostream>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/******************************************************************************/
+
+namespace
+{
+  constexpr std::uint64_t blockSize = 4 << 20;
+
+  bool sameExtent(const Extent& a, const Extent& b)
+  {
+    return a.file == b.file && a.sourceOffset == b.sourceOffset &&
+           a.outputOffset == b.outputOffset && a.length == b.length;
+  }
+
+  bool readFully(int fd, unsigned char* buffer, std::uint64_t length, std::uint64_t offset)
+  {
+    while (length > 0)
+    {
+      ssize_t bytesRead = pread(fd, buffer, length, offset);
+      if (bytesRead <= 0)
+        return false;
+
+      buffer += bytesRead;
+      length -= bytesRead;
+      offset += bytesRead;
+    }
+
+    return true;
+  }
+
+  bool writeFully(int fd, const unsigned char* buffer, std::uint64_t length, std::uint64_t offset)
+  {
+    while (length > 0)
+    {
+      ssize_t bytesWritten = pwrite(fd, buffer, length, offset);
+      if (bytesWritten <= 0)
+        return false;
+
+      buffer += bytesWritten;
+      length -= bytesWritten;
+      offset += bytesWritten;
+    }
+
+    return true;
+  }
+}
+
+/******************************************************************************/
+
+bool updateOutput(const std::vector<std::string>& fileNames,
+                  const std::vector<Extent>& oldExtents,
+                  const std::vector<Extent>& newExtents,
+                  const std::vector<bool>& changedFiles,
+                  const std::string& outputFileName)
+{
+  int output = open(outputFileName.c_str(), O_RDWR | O_CLOEXEC);
+  struct stat info;
+
+  if (output < 0 || fstat(output, &info) != 0)
+  {
+    std::cerr << "File: " << outputFileName << " failed to open." << '\n';
+    if (output >= 0)
+      close(output);
+    return false;
+  }
+
+  const std::uint64_t outputSize = info.st_size;
+  const std::uint64_t newSize = newExtents.empty() ? 0 : newExtents.back().outputOffset + newExtents.back().length;
+
+  // Extents in front of the first changed one are still in place
+  std::size_t first = 0;
+  while (first < newExtents.size() && first < oldExtents.size() &&
+         sameExtent(newExtents[first], oldExtents[first]) && !changedFiles[newExtents[first].file])
+    ++first;
+
+  std::vector<unsigned char> inputBuffer(blockSize), outputBuffer(blockSize);
+  std::uint64_t firstDifference = std::min(outputSize, newSize);
+  bool rewriting = false;
+  bool success = true;
+
+  for (std::size_t i = first; i < newExtents.size() && success; ++i)
+  {
+    const Extent& extent = newExtents[i];
+    if (extent.length == 0)
+      continue;
+
+    int input = open(fileNames[extent.file].c_str(), O_RDONLY | O_CLOEXEC);
+    if (input < 0)
+    {
+      std::cerr << "File: " << fileNames[extent.file] << " failed to open." << '\n';
+      success = false;
+      break;
+    }
+
+    for (std::uint64_t offset = 0; offset < extent.length; offset += blockSize)
+    {
+      std::uint64_t length = std::min(blockSize, extent.length - offset);
+      std::uint64_t position = extent.outputOffset + offset;
+
+      if (!readFully(input, &inputBuffer[0], length, extent.sourceOffset + offset))
+      {
+        std::cerr << "File: " << fileNames[extent.file] << " could not be read." << '\n';
+        success = false;
+        break;
+      }
+
+      // Compare as long as the output has not been found to differ
+      std::uint64_t equal = 0;
+      if (!rewriting)
+      {
+        std::uint64_t comparable = position < outputSize ? std::min(length, outputSize - position) : 0;
+
+        if (comparable > 0 && !readFully(output, &outputBuffer[0], comparable, position))
+        {
+          std::cerr << "File: " << outputFileName << " could not be read." << '\n';
+          success = false;
+          break;
+        }
+
+        while (equal < comparable && inputBuffer[equal] == outputBuffer[equal])
+          ++equal;
+
+        if (equal == length)
+          continue;
+
+        rewriting = true;
+        firstDifference = position + equal;
+      }
+
+      if (!writeFully(output, &inputBuffer[equal], length - equal, position + equal))
+      {
+        std::cerr << "File: " << outputFileName << " could not be written." << '\n';
+        success = false;
+        break;
+      }
+    }
+
+    close(input);
+  }
+
+  if (success && outputSize != newSize && ftruncate(output, newSize) != 0)
+  {
+    std::cerr << "File: " << outputFileName << " could not be truncated." << '\n';
+    success = false;
+  }
+
+  if (close(output) != 0 && success)
+  {
+    std::cerr << "File: " << outputFileName << " could not be written." << '\n';
+    success = false;
+  }
+
+  if (!success)
+    return false;
+
+  if (!rewriting && outputSize == newSize)
+    std::cout << "Output " << getFilename(outputFileName) << " is up to date\n";
+  else if (!rewriting)
+    std::cout << "Output " << getFilename(outputFileName) << " truncated to " << newSize << " bytes\n";
+  else
+    std::cout << "Output " << getFilename(outputFileName) << " updated from offset "
+              << firstDifference << " (" << newSize - firstDifference << " bytes rewritten)\n";
+
+  return true;
+}
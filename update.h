@@ -0,0 +1,22 @@
+#ifndef UPDATE_H
+#define UPDATE_H
+
+#include <string>
+#include <vector>
+
+#include "binmerge.h"
+
+/******************************************************************************/
+
+// Brings an output that was merged according to oldExtents up to date with
+// newExtents after some input files (marked in changedFiles) have changed.
+// Everything in front of the first affected extent is kept without reading
+// it. From there on, the output is compared with its new content and only
+// rewritten from the first differing byte. Returns true on success.
+bool updateOutput(const std::vector<std::string>& fileNames,
+                  const std::vector<Extent>& oldExtents,
+                  const std::vector<Extent>& newExtents,
+                  const std::vector<bool>& changedFiles,
+                  const std::string& outputFileName);
+
+#endif // UPDATE_H
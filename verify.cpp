@@ -0,0 +1,161 @@
+#include "verify.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <thread>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/******************************************************************************/
+
+namespace
+{
+  constexpr std::uint64_t blockSize = 4 << 20;
+
+  // Part of an extent that is compared by a single worker
+  struct Block
+  {
+    std::size_t extent;
+    std::uint64_t offset; // relative to the start of the extent
+    std::uint64_t length;
+  };
+
+  bool readFully(int fd, unsigned char* buffer, std::uint64_t length, std::uint64_t offset)
+  {
+    while (length > 0)
+    {
+      ssize_t bytesRead = pread(fd, buffer, length, offset);
+      if (bytesRead <= 0)
+        return false;
+
+      buffer += bytesRead;
+      length -= bytesRead;
+      offset += bytesRead;
+    }
+
+    return true;
+  }
+}
+
+/******************************************************************************/
+
+bool verifyOutput(const std::vector<std::string>& fileNames,
+                  const std::vector<Extent>& extents,
+                  const std::string& outputFileName,
+                  unsigned threads)
+{
+  int output = open(outputFileName.c_str(), O_RDONLY | O_CLOEXEC);
+  if (output < 0)
+  {
+    std::cerr << "File: " << outputFileName << " failed to open." << '\n';
+    return false;
+  }
+
+  // The output has to be exactly as long as all extents together
+  struct stat info;
+  std::uint64_t expectedSize = extents.empty() ? 0 : extents.back().outputOffset + extents.back().length;
+
+  if (fstat(output, &info) != 0)
+  {
+    std::cerr << "File: " << outputFileName << " could not be examined: " << std::strerror(errno) << '\n';
+    close(output);
+    return false;
+  }
+
+  if (static_cast<std::uint64_t>(info.st_size) != expectedSize)
+  {
+    std::cout << "Verification failed: output has " << info.st_size
+              << " bytes instead of " << expectedSize << '\n';
+    close(output);
+    return false;
+  }
+
+  std::vector<Block> blocks;
+  for (std::size_t i = 0; i < extents.size(); ++i)
+    for (std::uint64_t offset = 0; offset < extents[i].length; offset += blockSize)
+      blocks.push_back(Block{i, offset, std::min(blockSize, extents[i].length - offset)});
+
+  // Blocks behind the first differing one need not be compared anymore
+  std::atomic<std::size_t> nextBlock(0), failedBlock(blocks.size());
+  std::mutex mutex;
+  std::uint64_t firstDifference = expectedSize;
+  std::size_t differingExtent = 0;
+
+  auto worker = [&]
+  {
+    std::vector<unsigned char> inputBuffer(blockSize), outputBuffer(blockSize);
+    std::size_t openFile = fileNames.size();
+    int input = -1;
+
+    for (std::size_t b; (b = nextBlock++) < failedBlock;)
+    {
+      const Block& block = blocks[b];
+      const Extent& extent = extents[block.extent];
+
+      // Blocks are handed out in output order, so the input rarely changes
+      if (extent.file != openFile)
+      {
+        if (input >= 0)
+          close(input);
+
+        input = open(fileNames[extent.file].c_str(), O_RDONLY | O_CLOEXEC);
+        openFile = extent.file;
+      }
+
+      bool equal = input >= 0 &&
+        readFully(input, &inputBuffer[0], block.length, extent.sourceOffset + block.offset) &&
+        readFully(output, &outputBuffer[0], block.length, extent.outputOffset + block.offset);
+
+      std::uint64_t position = 0;
+      if (equal && std::memcmp(&inputBuffer[0], &outputBuffer[0], block.length) != 0)
+      {
+        equal = false;
+        while (inputBuffer[position] == outputBuffer[position])
+          ++position;
+      }
+
+      if (!equal)
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (extent.outputOffset + block.offset + position < firstDifference)
+        {
+          firstDifference = extent.outputOffset + block.offset + position;
+          differingExtent = block.extent;
+        }
+        failedBlock = std::min<std::size_t>(failedBlock, b);
+      }
+    }
+
+    if (input >= 0)
+      close(input);
+  };
+
+  std::vector<std::thread> workers;
+  for (unsigned t = 1; t < threads; ++t)
+    workers.emplace_back(worker);
+
+  worker();
+
+  for (auto& thread : workers)
+    thread.join();
+
+  close(output);
+
+  if (failedBlock < blocks.size())
+  {
+    std::cout << "Verification failed: output differs from "
+              << getFilename(fileNames[extents[differingExtent].file])
+              << " at output offset " << firstDifference << '\n';
+    return false;
+  }
+
+  std::cout << "Verification succeeded: " << expectedSize << " bytes in "
+            << extents.size() << " extents match their sources\n";
+  return true;
+}
@@ -0,0 +1,19 @@
+#ifndef VERIFY_H
+#define VERIFY_H
+
+#include <string>
+#include <vector>
+
+#include "binmerge.h"
+
+/******************************************************************************/
+
+// Checks that every extent of the output equals its source range. The extents
+// are split into blocks that are read and compared on several threads at
+// once, so that all involved devices are busy. Returns true on success.
+bool verifyOutput(const std::vector<std::string>& fileNames,
+                  const std::vector<Extent>& extents,
+                  const std::string& outputFileName,
+                  unsigned threads);
+
+#endif // VERIFY_H
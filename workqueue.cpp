@@ -0,0 +1,195 @@
+#include "workqueue.h"
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <system_error>
+
+#include <cerrno>
+#include <ctime>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/******************************************************************************/
+
+namespace
+{
+  // Holds the exclusive queue lock for the lifetime of the object
+  class QueueLock
+  {
+  public:
+    explicit QueueLock(int fd) : fd(fd)
+    {
+      while (flock(fd, LOCK_EX) != 0)
+        if (errno != EINTR)
+          throw std::system_error(errno, std::generic_category(), "flock");
+    }
+
+    ~QueueLock()
+    {
+      flock(fd, LOCK_UN);
+    }
+
+  private:
+    int fd;
+  };
+
+  bool fileExists(const std::string& path)
+  {
+    struct stat info;
+    return stat(path.c_str(), &info) == 0;
+  }
+
+  void writeFile(const std::string& path, const std::string& content)
+  {
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    file << content;
+    file.close();
+
+    if (!file)
+      throw std::system_error(errno, std::generic_category(), path);
+  }
+
+  std::string readFile(const std::string& path)
+  {
+    std::ifstream file(path, std::ios::binary);
+    std::ostringstream content;
+    content << file.rdbuf();
+    return content.str();
+  }
+}
+
+/******************************************************************************/
+
+WorkQueue::WorkQueue(const std::string& directory, const std::vector<std::string>& manifest,
+                     std::chrono::seconds staleAfter)
+  : directory(directory), staleAfter(staleAfter)
+{
+  if (mkdir(directory.c_str(), 0777) != 0 && errno != EEXIST)
+    throw std::system_error(errno, std::generic_category(), directory);
+
+  auto lockPath = directory + "/queue.lock";
+  lockFile = open(lockPath.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0666);
+  if (lockFile < 0)
+    throw std::system_error(errno, std::generic_category(), lockPath);
+
+  // The first worker records the job description, all others have to match it
+  std::string description;
+  for (const auto& line : manifest)
+    description += line + '\n';
+
+  bool sameJob = true;
+  {
+    QueueLock lock(lockFile);
+    auto manifestPath = directory + "/manifest";
+
+    if (!fileExists(manifestPath))
+      writeFile(manifestPath, description);
+    else
+      sameJob = readFile(manifestPath) == description;
+  }
+
+  // The lock is released by now, the destructor will not run
+  if (!sameJob)
+  {
+    close(lockFile);
+    throw std::runtime_error(directory + " belongs to a different job");
+  }
+}
+
+WorkQueue::~WorkQueue()
+{
+  close(lockFile);
+}
+
+std::string WorkQueue::jobPath(std::size_t job, const char* suffix) const
+{
+  return directory + "/job-" + std::to_string(job) + suffix;
+}
+
+bool WorkQueue::claim(std::size_t& job, std::size_t first, std::size_t last)
+{
+  QueueLock lock(lockFile);
+
+  for (std::size_t i = first; i < last; ++i)
+  {
+    if (fileExists(jobPath(i, ".done")))
+      continue;
+
+    // Skip jobs held by a worker that is still sending heartbeats
+    struct stat info;
+    if (stat(jobPath(i, ".claim").c_str(), &info) == 0 &&
+        std::difftime(std::time(nullptr), info.st_mtime) < staleAfter.count())
+      continue;
+
+    char host[256] = {};
+    gethostname(host, sizeof(host) - 1);
+    writeFile(jobPath(i, ".claim"), std::string(host) + ' ' + std::to_string(getpid()) + '\n');
+
+    job = i;
+    return true;
+  }
+
+  return false;
+}
+
+void WorkQueue::heartbeat(std::size_t job)
+{
+  utimensat(AT_FDCWD, jobPath(job, ".claim").c_str(), nullptr, 0);
+}
+
+void WorkQueue::complete(std::size_t job, const std::string& result)
+{
+  // Publish the result atomically, a reclaimed job may be completed twice
+  auto temporaryPath = jobPath(job, ".tmp.") + std::to_string(getpid());
+  writeFile(temporaryPath, result);
+
+  QueueLock lock(lockFile);
+
+  if (rename(temporaryPath.c_str(), jobPath(job, ".done").c_str()) != 0)
+    throw std::system_error(errno, std::generic_category(), jobPath(job, ".done"));
+
+  unlink(jobPath(job, ".claim").c_str());
+}
+
+bool WorkQueue::isDone(std::size_t first, std::size_t last) const
+{
+  for (std::size_t i = first; i < last; ++i)
+    if (!fileExists(jobPath(i, ".done")))
+      return false;
+
+  return true;
+}
+
+std::string WorkQueue::result(std::size_t job) const
+{
+  return readFile(jobPath(job, ".done"));
+}
+
+/******************************************************************************/
+
+Heartbeat::Heartbeat(WorkQueue& queue, std::size_t job)
+{
+  // Refresh the claim a few times per stale timeout
+  auto interval = std::max(queue.staleTimeout() / 4, std::chrono::seconds(1));
+
+  thread = std::thread([this, &queue, job, interval]
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (!stopped.wait_for(lock, interval, [this] { return stop; }))
+      queue.heartbeat(job);
+  });
+}
+
+Heartbeat::~Heartbeat()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stop = true;
+  }
+  stopped.notify_one();
+  thread.join();
+}
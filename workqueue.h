@@ -0,0 +1,68 @@
+#ifndef WORKQUEUE_H
+#define WORKQUEUE_H
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/******************************************************************************/
+
+// Work queue shared by several binmerge processes through a directory.
+// Every job is represented by two files: "job-N.claim" while a worker is
+// processing it and "job-N.done" holding its result. All state transitions
+// are serialized by an flock() on "queue.lock", so the directory may also
+// live on a shared filesystem that supports flock (e.g. NFSv4).
+// Claims whose modification time is older than the stale timeout are
+// considered abandoned and are handed out again.
+class WorkQueue
+{
+public:
+  WorkQueue(const std::string& directory, const std::vector<std::string>& manifest,
+            std::chrono::seconds staleAfter);
+  ~WorkQueue();
+
+  WorkQueue(const WorkQueue&) = delete;
+  WorkQueue& operator=(const WorkQueue&) = delete;
+
+  // Claims a job within [first, last) that is neither done nor held by a live worker
+  bool claim(std::size_t& job, std::size_t first, std::size_t last);
+
+  // Refreshes the claim of a job so that it will not be considered stale
+  void heartbeat(std::size_t job);
+
+  // Stores the result of a job and releases its claim
+  void complete(std::size_t job, const std::string& result);
+
+  bool isDone(std::size_t first, std::size_t last) const;
+  std::string result(std::size_t job) const;
+
+  std::chrono::seconds staleTimeout() const { return staleAfter; }
+
+private:
+  std::string jobPath(std::size_t job, const char* suffix) const;
+
+  std::string directory;
+  std::chrono::seconds staleAfter;
+  int lockFile = -1;
+};
+
+/******************************************************************************/
+
+// Keeps the claim of a job alive while it is being processed
+class Heartbeat
+{
+public:
+  Heartbeat(WorkQueue& queue, std::size_t job);
+  ~Heartbeat();
+
+private:
+  std::mutex mutex;
+  std::condition_variable stopped;
+  bool stop = false;
+  std::thread thread;
+};
+
+#endif // WORKQUEUE_H